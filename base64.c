@@ -0,0 +1,93 @@
+#include "base64.h"
+#include <string.h>
+
+static const char ENCODE_TABLE[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#define B64_INVALID 0x80 // high bit: not part of the alphabet
+#define B64_PAD 0x81
+
+// Built from ENCODE_TABLE on first use
+static unsigned char DECODE_TABLE[256];
+static int decode_table_ready = 0;
+
+static void build_decode_table(void) {
+    memset(DECODE_TABLE, B64_INVALID, sizeof(DECODE_TABLE));
+    for (int i = 0; i < 64; i++)
+        DECODE_TABLE[(unsigned char)ENCODE_TABLE[i]] = (unsigned char)i;
+    DECODE_TABLE['='] = B64_PAD;
+    decode_table_ready = 1;
+}
+
+size_t base64_encode(const unsigned char *in, size_t n, char *out) {
+    size_t i = 0, e = 0;
+    // Whole triples: three bytes in, four chars out
+    for (; i + 3 <= n; i += 3) {
+        unsigned int v = ((unsigned int)in[i] << 16) | ((unsigned int)in[i + 1] << 8) | in[i + 2];
+        out[e] = ENCODE_TABLE[v >> 18];
+        out[e + 1] = ENCODE_TABLE[(v >> 12) & 63];
+        out[e + 2] = ENCODE_TABLE[(v >> 6) & 63];
+        out[e + 3] = ENCODE_TABLE[v & 63];
+        e += 4;
+    }
+    if (i < n) {
+        unsigned int v = (unsigned int)in[i] << 16;
+        if (i + 1 < n) v |= (unsigned int)in[i + 1] << 8;
+        out[e] = ENCODE_TABLE[v >> 18];
+        out[e + 1] = ENCODE_TABLE[(v >> 12) & 63];
+        out[e + 2] = (i + 1 < n) ? ENCODE_TABLE[(v >> 6) & 63] : '=';
+        out[e + 3] = '=';
+        e += 4;
+    }
+    out[e] = 0;
+    return e;
+}
+
+void base64_decoder_init(Base64Decoder *d) {
+    d->val = 0;
+    d->bits = 0;
+    d->done = 0;
+    if (!decode_table_ready) build_decode_table();
+}
+
+size_t base64_decode_update(Base64Decoder *d, const char *in, size_t len, unsigned char *out) {
+    const unsigned char *p = (const unsigned char *)in;
+    size_t o = 0, i = 0;
+    if (d->done) return 0;
+
+    while (i < len) {
+        // Fast path: on a quartet boundary with four alphabet chars ahead
+        if (d->bits == 0) {
+            while (i + 4 <= len) {
+                unsigned char a = DECODE_TABLE[p[i]], b = DECODE_TABLE[p[i + 1]];
+                unsigned char c = DECODE_TABLE[p[i + 2]], e = DECODE_TABLE[p[i + 3]];
+                if ((a | b | c | e) & B64_INVALID) break;
+                unsigned int v = ((unsigned int)a << 18) | ((unsigned int)b << 12) | ((unsigned int)c << 6) | e;
+                out[o] = (unsigned char)(v >> 16);
+                out[o + 1] = (unsigned char)(v >> 8);
+                out[o + 2] = (unsigned char)v;
+                o += 3;
+                i += 4;
+            }
+            if (i >= len) break;
+        }
+
+        // Slow path: one char at a time (padding, line breaks, chunk edges)
+        unsigned char ch = p[i++];
+        if (ch == 0) break;
+        unsigned char v = DECODE_TABLE[ch];
+        if (v == B64_PAD) {
+            d->done = 1;
+            break;
+        }
+        if (v & B64_INVALID) continue;
+        d->val = (d->val << 6) | v;
+        d->bits += 6;
+        if (d->bits >= 8) {
+            d->bits -= 8;
+            out[o++] = (unsigned char)(d->val >> d->bits);
+        }
+        if (d->bits == 0) d->val = 0;
+    }
+    return o;
+}
@@ -0,0 +1,28 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <stddef.h>
+
+// Table-driven base64 (RFC 4648 alphabet). Both directions work on chunks:
+// encode blocks whose length is a multiple of 3 (only the last may not be),
+// and feed the decoder as much text as is at hand.
+
+#define BASE64_ENCODED_LEN(n) ((((n) + 2) / 3) * 4)
+#define BASE64_DECODED_MAX(n) (((n) / 4) * 3 + 3)
+
+// Writes BASE64_ENCODED_LEN(n) chars plus a NUL; returns the char count
+size_t base64_encode(const unsigned char *in, size_t n, char *out);
+
+// Carries the partial quartet between chunks
+typedef struct {
+    unsigned int val;
+    int bits;
+    int done; // saw '=': the rest is padding
+} Base64Decoder;
+
+void base64_decoder_init(Base64Decoder *d);
+// Decodes up to len chars (stops early at NUL); skips characters outside the
+// alphabet (line breaks etc.). out needs BASE64_DECODED_MAX(len) bytes.
+size_t base64_decode_update(Base64Decoder *d, const char *in, size_t len, unsigned char *out);
+
+#endif
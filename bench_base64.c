@@ -0,0 +1,151 @@
+// Base64 microbenchmark: the old strchr/fputc codec from chat.c vs base64.c.
+// Build: gcc -O2 bench_base64.c base64.c -o bench_base64
+// Run:   bench_base64 [MegaBytes]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "base64.h"
+
+#define BLOCK_BYTES (64 * 1024)
+
+// --- Legacy codec (as chat.c had it) ---
+static const char base64_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int base64_value(char c)
+{
+    const char *p = strchr(base64_table, c);
+    return p ? (int)(p - base64_table) : -1;
+}
+
+static void legacy_decode(const char *in, FILE *fp)
+{
+    int val = 0, valb = -8;
+    for (int i = 0; in[i] && in[i] != '='; i++) {
+        int v = base64_value(in[i]);
+        if (v < 0) continue;
+        val = (val << 6) + v;
+        valb += 6;
+        if (valb >= 0) {
+            fputc((val >> valb) & 0xFF, fp);
+            valb -= 8;
+        }
+    }
+}
+
+static char *legacy_encode(const unsigned char *data, long size)
+{
+    char *encoded = malloc(size * 2);
+    int e = 0;
+    for (long i = 0; i < size; i += 3) {
+        int b1 = data[i];
+        int b2 = (i+1<size) ? data[i+1] : 0;
+        int b3 = (i+2<size) ? data[i+2] : 0;
+
+        encoded[e++] = base64_table[b1>>2];
+        encoded[e++] = base64_table[((b1&3)<<4)|(b2>>4)];
+        encoded[e++] = (i+1<size) ? base64_table[((b2&15)<<2)|(b3>>6)] : '=';
+        encoded[e++] = (i+2<size) ? base64_table[b3&63] : '=';
+    }
+    encoded[e] = 0;
+    return encoded;
+}
+
+// --- Streaming decode to disk in blocks ---
+static void block_decode(const char *in, size_t len, FILE *fp)
+{
+    static unsigned char block[BASE64_DECODED_MAX(BLOCK_BYTES)];
+    Base64Decoder d;
+    base64_decoder_init(&d);
+    for (size_t off = 0; off < len; off += BLOCK_BYTES) {
+        size_t n = len - off < BLOCK_BYTES ? len - off : BLOCK_BYTES;
+        fwrite(block, 1, base64_decode_update(&d, in + off, n, block), fp);
+    }
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double secs, size_t bytes)
+{
+    printf("  %-28s %8.1f MB/s\n", name, bytes / secs / (1024.0 * 1024.0));
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = (size_t)(argc > 1 ? atof(argv[1]) : 16) * 1024 * 1024;
+    unsigned char *data = malloc(size);
+    srand(1);
+    for (size_t i = 0; i < size; i++)
+        data[i] = (unsigned char)rand();
+
+    printf("--- base64: %zu MB of random bytes ---\n", size / (1024 * 1024));
+
+    // Encode
+    double t = now_sec();
+    char *old_text = legacy_encode(data, (long)size);
+    report("encode (legacy)", now_sec() - t, size);
+
+    char *text = malloc(BASE64_ENCODED_LEN(size) + 1);
+    t = now_sec();
+    size_t text_len = base64_encode(data, size, text);
+    report("encode (table)", now_sec() - t, size);
+
+    if (strcmp(old_text, text) != 0) {
+        printf("FAIL: encoders disagree\n");
+        return 1;
+    }
+
+    // Decode to disk; MB/s is measured on decoded bytes
+    FILE *fp = tmpfile();
+    t = now_sec();
+    legacy_decode(text, fp);
+    fflush(fp);
+    report("decode+write (strchr/fputc)", now_sec() - t, size);
+    fclose(fp);
+
+    fp = tmpfile();
+    t = now_sec();
+    block_decode(text, text_len, fp);
+    fflush(fp);
+    report("decode+write (table/block)", now_sec() - t, size);
+
+    // Round trip check
+    rewind(fp);
+    unsigned char *back = malloc(size);
+    size_t got = fread(back, 1, size, fp);
+    fclose(fp);
+    if (got != size || memcmp(back, data, size) != 0) {
+        printf("FAIL: round trip mismatch\n");
+        return 1;
+    }
+
+    // Decode in memory, fed in odd-sized chunks to exercise the carry
+    unsigned char *out = malloc(BASE64_DECODED_MAX(text_len));
+    t = now_sec();
+    Base64Decoder d;
+    base64_decoder_init(&d);
+    size_t o = 0;
+    for (size_t off = 0; off < text_len; off += 1021) {
+        size_t n = text_len - off < 1021 ? text_len - off : 1021;
+        o += base64_decode_update(&d, text + off, n, out + o);
+    }
+    report("decode (1021-char chunks)", now_sec() - t, size);
+    if (o != size || memcmp(out, data, size) != 0) {
+        printf("FAIL: chunked decode mismatch\n");
+        return 1;
+    }
+
+    printf("PASS\n");
+    free(data);
+    free(old_text);
+    free(text);
+    free(back);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,286 @@
+// Damage engine microbenchmark: calculate_damage_logic(), get_type_multiplier(),
+// apply_boost(), get_pokemon()/get_move() and load_pokemon_data() over the Pokemon the
+// engine loads from pokemon.csv: the first MAX_POKEMON rows, not the whole file.
+// Each case runs a warmup pass, then [Reps] timed passes; ns/op is reported as the
+// median and the best pass, with hardware cache misses per op where perf events are
+// allowed (Linux, perf_event_paranoid permitting). Results can also be written as
+// JSON, one case per line, and compared against an earlier run's file.
+// Build: gcc -O2 bench_damage.c damage_calc.c -o bench_damage -lm
+// Run:   bench_damage [Reps] [OutJson] [BaselineJson] [PokemonCsv]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "damage_calc.h"
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+#endif
+
+#define DEFAULT_REPS 7
+#define MAX_REPS 101
+#define LOAD_CALLS 20   // load_pokemon_data() calls per pass
+#define BOOST_SWEEPS 64 // apply_boost() is too cheap to time in one sweep
+#define MAX_CASES 16
+
+typedef struct
+{
+    const char *name;
+    double median_ns; // per op
+    double best_ns;
+    long long ops;    // per pass
+    double misses;    // per op, median pass; < 0 when not counted
+} BenchResult;
+
+static BenchResult results[MAX_CASES];
+static int result_count;
+static volatile long long sink; // keeps the work from being optimized out
+
+// --- Timing ---
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// --- Cache misses ---
+static int miss_fd = -1;
+
+static void counter_open(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    miss_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static void counter_start(void)
+{
+#ifdef __linux__
+    if (miss_fd < 0)
+        return;
+    ioctl(miss_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(miss_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static long long counter_stop(void)
+{
+#ifdef __linux__
+    long long count;
+    if (miss_fd < 0)
+        return -1;
+    ioctl(miss_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(miss_fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+    return count;
+#else
+    return -1;
+#endif
+}
+
+// --- Cases ---
+// Each pass function does one full sweep and returns the number of ops it made
+
+static long long pass_damage(void)
+{
+    // Every attacker against every defender, with a move that walks MOVE_DB
+    long long acc = 0, ops = 0;
+    for (int a = 0; a < POKEMON_COUNT; a++)
+        for (int d = 0; d < POKEMON_COUNT; d++, ops++)
+        {
+            const char *move = MOVE_DB[(a + d) % MOVE_COUNT].name;
+            DamageResult r = calculate_damage_logic(POKEMON_DB[a].name, POKEMON_DB[d].name, move);
+            acc += r.damage_dealt;
+        }
+    sink += acc;
+    return ops;
+}
+
+static long long pass_type_multiplier(void)
+{
+    float acc = 0.0f;
+    long long ops = 0;
+    for (int m = 0; m < MOVE_COUNT; m++)
+        for (int d = 0; d < POKEMON_COUNT; d++, ops++)
+            acc += get_type_multiplier(MOVE_DB[m].type, POKEMON_DB[d].type1, POKEMON_DB[d].type2);
+    sink += (long long)acc;
+    return ops;
+}
+
+static long long pass_boost(void)
+{
+    long long acc = 0, ops = 0;
+    for (int sweep = 0; sweep < BOOST_SWEEPS; sweep++)
+        for (int p = 0; p < POKEMON_COUNT; p++)
+            for (int stage = -6; stage <= 6; stage++, ops += 2)
+                acc += apply_boost(POKEMON_DB[p].attack, stage) + apply_boost(POKEMON_DB[p].sp_defense, stage);
+    sink += acc;
+    return ops;
+}
+
+static long long pass_get_pokemon(void)
+{
+    // Every name once, plus a miss that has to scan the whole table
+    long long acc = 0, ops = 0;
+    for (int p = 0; p < POKEMON_COUNT; p++, ops++)
+        acc += get_pokemon(POKEMON_DB[p].name)->hp;
+    acc += get_pokemon("MissingNo") == NULL;
+    sink += acc;
+    return ops + 1;
+}
+
+static long long pass_get_move(void)
+{
+    long long acc = 0, ops = 0;
+    for (int m = 0; m < MOVE_COUNT; m++, ops++)
+        acc += get_move(MOVE_DB[m].name)->power;
+    acc += get_move("Struggle") == NULL;
+    sink += acc;
+    return ops + 1;
+}
+
+static const char *csv_path = "pokemon.csv";
+
+static long long pass_load(void)
+{
+    for (int i = 0; i < LOAD_CALLS; i++)
+        load_pokemon_data(csv_path);
+    sink += POKEMON_COUNT;
+    return LOAD_CALLS;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_case(const char *name, long long (*pass)(void), int reps)
+{
+    double ns[MAX_REPS], misses[MAX_REPS];
+    long long ops = pass(); // warmup: caches, branch predictors, page faults
+    for (int r = 0; r < reps; r++)
+    {
+        counter_start();
+        long long t = now_ns();
+        ops = pass();
+        long long elapsed = now_ns() - t;
+        long long m = counter_stop();
+        ns[r] = (double)elapsed / ops;
+        misses[r] = m < 0 ? -1.0 : (double)m / ops;
+    }
+    qsort(ns, reps, sizeof(double), compare_double);
+    qsort(misses, reps, sizeof(double), compare_double);
+
+    BenchResult *res = &results[result_count++];
+    res->name = name;
+    res->median_ns = ns[reps / 2];
+    res->best_ns = ns[0];
+    res->ops = ops;
+    res->misses = misses[reps / 2];
+
+    if (res->misses < 0)
+        printf("  %-24s %10.1f ns/op  (best %8.1f)  %9lld ops/pass  cache misses n/a\n", name,
+               res->median_ns, res->best_ns, ops);
+    else
+        printf("  %-24s %10.1f ns/op  (best %8.1f)  %9lld ops/pass  %8.3f misses/op\n", name,
+               res->median_ns, res->best_ns, ops, res->misses);
+}
+
+// --- Results file ---
+static int write_json(const char *path, int reps)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        printf("Could not write %s\n", path);
+        return 1;
+    }
+    fprintf(f, "{\"pokemon\":%d,\"moves\":%d,\"reps\":%d,\"results\":[\n", POKEMON_COUNT, MOVE_COUNT, reps);
+    for (int i = 0; i < result_count; i++)
+    {
+        const BenchResult *r = &results[i];
+        fprintf(f, "{\"name\":\"%s\",\"ns_per_op\":%.3f,\"best_ns_per_op\":%.3f,\"ops\":%lld,", r->name,
+                r->median_ns, r->best_ns, r->ops);
+        if (r->misses < 0)
+            fprintf(f, "\"cache_misses_per_op\":null}");
+        else
+            fprintf(f, "\"cache_misses_per_op\":%.4f}", r->misses);
+        fprintf(f, "%s\n", i + 1 < result_count ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+    printf("Wrote %s\n", path);
+    return 0;
+}
+
+// Reads a file written by write_json(); it keeps one case per line
+static void compare_with(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        printf("Could not read baseline %s\n", path);
+        return;
+    }
+    printf("--- vs %s (median ns/op) ---\n", path);
+    char line[512], name[64];
+    double base;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "{\"name\":\"%63[^\"]\",\"ns_per_op\":%lf", name, &base) != 2 || base <= 0)
+            continue;
+        for (int i = 0; i < result_count; i++)
+            if (strcmp(results[i].name, name) == 0)
+                printf("  %-24s %10.1f -> %10.1f  %+6.1f%%\n", name, base, results[i].median_ns,
+                       (results[i].median_ns - base) / base * 100.0);
+    }
+    fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+    int reps = argc > 1 ? atoi(argv[1]) : DEFAULT_REPS;
+    if (reps < 1)
+        reps = 1;
+    if (reps > MAX_REPS)
+        reps = MAX_REPS;
+    if (argc > 4)
+        csv_path = argv[4];
+
+    load_all_pokemon_and_moves(csv_path);
+    if (POKEMON_COUNT < 2 || MOVE_COUNT < 1)
+    {
+        printf("FAIL: %s gave %d Pokemon and %d moves\n", csv_path, POKEMON_COUNT, MOVE_COUNT);
+        return 1;
+    }
+    counter_open();
+    printf("--- damage engine: %d Pokemon (capped at MAX_POKEMON %d), %d moves, %d reps after a warmup pass ---\n",
+           POKEMON_COUNT, MAX_POKEMON, MOVE_COUNT, reps);
+
+    run_case("calculate_damage_logic", pass_damage, reps);
+    run_case("get_type_multiplier", pass_type_multiplier, reps);
+    run_case("apply_boost", pass_boost, reps);
+    run_case("get_pokemon", pass_get_pokemon, reps);
+    run_case("get_move", pass_get_move, reps);
+    run_case("load_pokemon_data", pass_load, reps);
+
+    int rc = 0;
+    if (argc > 2 && argv[2][0])
+        rc = write_json(argv[2], reps);
+    if (argc > 3 && argv[3][0])
+        compare_with(argv[3]);
+    return rc;
+}
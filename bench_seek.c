@@ -0,0 +1,203 @@
+// Journal seek benchmark: index checkpoint + short replay vs replay from the start.
+// Build: gcc -O2 bench_seek.c journal.c game_logic.c damage_calc.c network.c net_uring.c timer_wheel.c
+//        metrics.c log.c chat.c base64.c sticker_cache.c -o bench_seek -std=gnu99 -lm -lpthread
+// Run:   bench_seek [Battles] [Seeks]   (from the directory with pokemon.csv)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "journal.h"
+#include "damage_calc.h"
+
+extern void parse_kv(char *buffer, GameMessage *msg);
+
+static FILE *out; // stdout proper: the battle logic's own prints go to /dev/null
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// --- Recording a tournament ---
+static void feed(BattleContext *ctx, const char *fmt, ...)
+{
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    GameMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    parse_kv(buf, &msg);
+    process_incoming_message(ctx, &msg);
+}
+
+// The peer's report always agrees with ours, so every turn finishes
+static void feed_report(BattleContext *ctx)
+{
+    feed(ctx, "message_type: CALCULATION_REPORT\nattacker: %s\nmove_used: %s\n"
+              "damage_dealt: %d\ndefender_hp_remaining: %d\n",
+         ctx->current_attacker, ctx->current_move,
+         ctx->local_calc_result.damage_dealt, ctx->local_calc_result.defender_remaining_hp);
+}
+
+// One journal holding many battles back to back, as a server session would
+static unsigned long record_tournament(int battles)
+{
+    Journal *j = journal_create(1, 0, 0);
+    if (!j)
+        return 0;
+    BattleContext ctx;
+    unsigned long turns = 0;
+    for (int b = 0; b < battles; b++)
+    {
+        const PokemonData *me = &POKEMON_DB[b % POKEMON_COUNT];
+        const PokemonData *opp = &POKEMON_DB[(b * 7 + 3) % POKEMON_COUNT];
+        init_battle_state(&ctx, ROLE_HOST, me->name);
+        ctx.journal = j;
+        journal_record_begin(j, ROLE_HOST, me->name);
+        feed(&ctx, "message_type: BATTLE_SETUP\nattacker: %s\n", opp->name);
+        for (int guard = 0; ctx.state != STATE_GAME_OVER && guard < 64; guard++)
+        {
+            if (ctx.is_my_turn)
+                execute_move_command(&ctx, me->abilities[0]);
+            else
+                feed(&ctx, "message_type: ATTACK_ANNOUNCE\nmove_name: %s\n", opp->abilities[0]);
+            feed_report(&ctx);
+        }
+        turns += ctx.turn_number;
+    }
+    journal_close(j);
+    journal_shutdown();
+    return turns;
+}
+
+static bool find_journal(char *path, size_t cap)
+{
+    DIR *d = opendir(JOURNAL_DIR);
+    struct dirent *e;
+    bool found = false;
+    while (d && (e = readdir(d)) != NULL)
+    {
+        size_t n = strlen(e->d_name);
+        if (n > 4 && strcmp(e->d_name + n - 4, ".pkj") == 0)
+        {
+            snprintf(path, cap, "%s/%s", JOURNAL_DIR, e->d_name);
+            found = true;
+        }
+    }
+    if (d)
+        closedir(d);
+    return found;
+}
+
+static long file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static bool same_battle(const BattleContext *a, const BattleContext *b)
+{
+    JournalState x, y;
+    journal_capture_state(a, &x);
+    journal_capture_state(b, &y);
+    return x.state == y.state && x.is_my_turn == y.is_my_turn && x.turn_number == y.turn_number &&
+           x.my_hp == y.my_hp && x.opponent_hp == y.opponent_hp && x.state_digest == y.state_digest &&
+           strcmp(a->my_pokemon, b->my_pokemon) == 0 && strcmp(a->opponent_pokemon, b->opponent_pokemon) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int battles = argc > 1 ? atoi(argv[1]) : 20000;
+    int seeks = argc > 2 ? atoi(argv[2]) : 2000;
+    out = fdopen(dup(fileno(stdout)), "w");
+    load_all_pokemon_and_moves("pokemon.csv");
+    if (!freopen("/dev/null", "w", stdout))
+        return 1;
+
+    // Record into a scratch directory so the journal is the only one there
+    char dir[] = "/tmp/bench_seek_XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0)
+        return 1;
+
+    double t = now_sec();
+    unsigned long turns = record_tournament(battles);
+    double record_s = now_sec() - t;
+    char path[256];
+    if (turns == 0 || !find_journal(path, sizeof(path)))
+    {
+        fprintf(out, "FAIL: nothing recorded\n");
+        return 1;
+    }
+    fprintf(out, "--- journal seek: %d battles, %lu turns, %.1f MB ---\n", battles, turns,
+            file_size(path) / (1024.0 * 1024.0));
+    fprintf(out, "  %-28s %8.1f ms\n", "record", record_s * 1000);
+
+    t = now_sec();
+    long checkpoints = journal_index_build(path);
+    fprintf(out, "  %-28s %8.1f ms (%ld checkpoints)\n", "index build", (now_sec() - t) * 1000, checkpoints);
+
+    JournalSeeker seeker;
+    if (checkpoints < 0 || !journal_seeker_open(&seeker, path) || seeker.turns != turns)
+    {
+        fprintf(out, "FAIL: index\n");
+        return 1;
+    }
+    char idx[300];
+    snprintf(idx, sizeof(idx), "%s%s", path, JOURNAL_INDEX_SUFFIX);
+    fprintf(out, "  %-28s %8.1f MB\n", "index size", file_size(idx) / (1024.0 * 1024.0));
+
+    // The same random turns both ways; a seeker without checkpoints has to
+    // replay from the first record
+    unsigned long *targets = malloc(sizeof(unsigned long) * (size_t)seeks);
+    srand(1);
+    for (int i = 0; i < seeks; i++)
+        targets[i] = 1 + (unsigned long)(((double)rand() / ((double)RAND_MAX + 1)) * turns);
+
+    BattleContext *indexed = malloc(sizeof(BattleContext) * (size_t)seeks);
+    t = now_sec();
+    for (int i = 0; i < seeks; i++)
+        if (!journal_seek(&seeker, targets[i], &indexed[i]))
+        {
+            fprintf(out, "FAIL: seek to %lu\n", targets[i]);
+            return 1;
+        }
+    double indexed_s = now_sec() - t;
+
+    JournalSeeker linear = seeker;
+    linear.count = 0;
+    int linear_seeks = seeks < 50 ? seeks : 50; // each one is a full replay
+    BattleContext ctx;
+    t = now_sec();
+    for (int i = 0; i < linear_seeks; i++)
+    {
+        if (!journal_seek(&linear, targets[i], &ctx) || !same_battle(&ctx, &indexed[i]))
+        {
+            fprintf(out, "FAIL: indexed and linear replay disagree at turn %lu\n", targets[i]);
+            return 1;
+        }
+    }
+    double linear_s = now_sec() - t;
+
+    fprintf(out, "  %-28s %8.2f us/seek (%d seeks)\n", "seek (index)", indexed_s * 1e6 / seeks, seeks);
+    fprintf(out, "  %-28s %8.2f us/seek (%d seeks)\n", "seek (replay from start)",
+            linear_s * 1e6 / linear_seeks, linear_seeks);
+
+    journal_seeker_close(&seeker);
+    remove(idx);
+    remove(path);
+    rmdir(JOURNAL_DIR);
+    if (chdir("/") == 0)
+        rmdir(dir);
+    fprintf(out, "PASS\n");
+    free(targets);
+    free(indexed);
+    return 0;
+}
@@ -1,104 +1,424 @@
 #include "chat.h"
 #include "network.h"  
+#include "base64.h"
+#include "sticker_cache.h"
+#include "profile.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static const char base64_table[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+// --- Sticker Transfers ---
+// A sticker is offered first by content hash (STICKER_OFFER). A receiver that
+// has it cached answers with a final STICKER_ACK and nothing else is sent;
+// otherwise it's streamed as numbered STICKER_CHUNKs sized to fit one datagram. The receiver writes chunks
+// straight to disk and answers with cumulative STICKER_ACKs; the sender keeps
+// at most STICKER_WINDOW chunks unacknowledged. If either side stops hearing
+// progress, the transfer resumes from the first chunk the receiver lacks.
+typedef struct {
+    bool active;
+    bool outgoing;
+    unsigned int id;
+    StickerHash hash;
+    StickerHash running; // over the bytes hashed so far (sender: file, receiver: in-order chunks)
+    long hashed;
+    NetSession *peer;
+    unsigned int peer_id;
+    char sender_name[64];
+    char path[128];
+    FILE *fp;
+    long size;
+    int chunk_count;
 
-static int base64_value(char c) {
-    const char *p = strchr(base64_table, c);
-    return p ? (int)(p - base64_table) : -1;
+    // Sending: the file is hashed a slice per pump, then offered
+    bool offered;
+    bool window_open; // the receiver answered the offer
+    int next_send;
+    int acked;       // every chunk below this has arrived
+
+    // Receiving
+    unsigned char *have; // bitmap of chunks on disk
+    int next_needed;
+    int unacked;     // in-order chunks since the last STICKER_ACK
+
+    long long last_progress;
+    int stalls;
+} StickerTransfer;
+
+extern long long current_time_ms();
+
+static StickerTransfer transfers[STICKER_MAX_TRANSFERS];
+
+static const char *find_field(const char *raw, const char *key)
+{
+    size_t klen = strlen(key);
+    for (const char *p = raw; (p = strstr(p, key)) != NULL; p += klen) {
+        if ((p == raw || p[-1] == '\n') && p[klen] == ':')
+            return p[klen + 1] == ' ' ? p + klen + 2 : p + klen + 1;
+    }
+    return NULL;
 }
 
-static bool decode_base64(const char *in, const char *path)
+static long field_long(const char *raw, const char *key, long fallback)
 {
-    FILE *fp = fopen(path, "wb");
-    if (!fp) return false;
+    const char *v = find_field(raw, key);
+    return v ? atol(v) : fallback;
+}
+
+static StickerTransfer *find_transfer(NetSession *peer, unsigned int id, bool outgoing)
+{
+    for (int i = 0; i < STICKER_MAX_TRANSFERS; i++) {
+        StickerTransfer *t = &transfers[i];
+        if (t->active && t->peer == peer && t->id == id && t->outgoing == outgoing)
+            return t;
+    }
+    return NULL;
+}
 
-    int val = 0, valb = -8;
-    for (int i = 0; in[i] && in[i] != '='; i++) {
-        int v = base64_value(in[i]);
-        if (v < 0) continue;
-        val = (val << 6) + v;
-        valb += 6;
-        if (valb >= 0) {
-            fputc((val >> valb) & 0xFF, fp);
-            valb -= 8;
+static StickerTransfer *alloc_transfer(void)
+{
+    for (int i = 0; i < STICKER_MAX_TRANSFERS; i++) {
+        if (!transfers[i].active) {
+            memset(&transfers[i], 0, sizeof(transfers[i]));
+            return &transfers[i];
         }
     }
+    return NULL;
+}
 
-    fclose(fp);
-    return true;
+static void end_transfer(StickerTransfer *t, bool keep_file)
+{
+    if (t->fp) fclose(t->fp);
+    if (!t->outgoing && !keep_file) remove(t->path);
+    free(t->have);
+    t->fp = NULL;
+    t->have = NULL;
+    t->active = false;
 }
 
-void send_chat_text(const char *sender, const char *text)
+static void send_ack(unsigned int id, int next_chunk, const char *flags)
 {
-    char payload[2048];
+    char payload[96];
     snprintf(payload, sizeof(payload),
-        "sender_name: %s\n"
-        "content_type: TEXT\n"
-        "message_text: %s\n",
-        sender, text);
+        "sticker_id: %u\n"
+        "next_chunk: %d\n"
+        "%s", id, next_chunk, flags);
+    net_send_game_message("STICKER_ACK", payload);
+}
 
-    net_send_game_message("CHAT_MESSAGE", payload);
+static void send_sticker_ack(StickerTransfer *t, bool resume)
+{
+    send_ack(t->id, t->next_needed, resume ? "resume: 1\n" : "");
+    t->unacked = 0;
+}
+
+static void show_sticker(const char *sender, const char *path)
+{
+    ChatMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    snprintf(msg.sender_name, sizeof(msg.sender_name), "%s", sender);
+    msg.content_type = CHAT_STICKER;
+    snprintf(msg.sticker_filename, sizeof(msg.sticker_filename), "%s", path);
+    printf("\r");
+    display_chat_message(&msg);
+}
+
+static bool send_sticker_chunk(StickerTransfer *t, int index)
+{
+    unsigned char data[STICKER_CHUNK_BYTES];
+    char payload[128 + BASE64_ENCODED_LEN(STICKER_CHUNK_BYTES) + 2];
+
+    fseek(t->fp, (long)index * STICKER_CHUNK_BYTES, SEEK_SET);
+    int n = (int)fread(data, 1, STICKER_CHUNK_BYTES, t->fp);
+    if (n <= 0) return false;
+
+    int len = snprintf(payload, sizeof(payload),
+        "sticker_id: %u\n"
+        "chunk_index: %d\n"
+        "sticker_data: ", t->id, index);
+    len += (int)base64_encode(data, n, payload + len);
+    payload[len++] = '\n';
+    payload[len] = 0;
+    net_send_game_message("STICKER_CHUNK", payload);
+    return true;
 }
 
 void send_chat_sticker(const char *sender, const char *file_path)
 {
+    NetSession *peer = net_active_session();
+    if (!peer) return;
+
     FILE *fp = fopen(file_path, "rb");
     if (!fp) {
         printf("[CHAT] Sticker not found: %s\n", file_path);
         return;
     }
-
     fseek(fp, 0, SEEK_END);
     long size = ftell(fp);
     rewind(fp);
+    if (size <= 0 || size > STICKER_MAX_BYTES) {
+        printf("[CHAT] Sticker %s is empty or too large\n", file_path);
+        fclose(fp);
+        return;
+    }
 
-    unsigned char *data = malloc(size);
-    fread(data, 1, size, fp);
-    fclose(fp);
-
-    char *encoded = malloc(size * 2);
-    int e = 0;
-    for (long i = 0; i < size; i += 3) {
-        int b1 = data[i];
-        int b2 = (i+1<size) ? data[i+1] : 0;
-        int b3 = (i+2<size) ? data[i+2] : 0;
+    StickerTransfer *t = alloc_transfer();
+    if (!t) {
+        printf("[CHAT] Too many stickers in flight, try again shortly\n");
+        fclose(fp);
+        return;
+    }
+    t->active = true;
+    t->outgoing = true;
+    t->id = ((unsigned int)rand() << 8) ^ (unsigned int)(t - transfers) ^ (unsigned int)current_time_ms();
+    t->running = STICKER_HASH_INIT;
+    t->peer = peer;
+    t->peer_id = net_session_id(peer);
+    t->fp = fp;
+    t->size = size;
+    t->chunk_count = (int)((size + STICKER_CHUNK_BYTES - 1) / STICKER_CHUNK_BYTES);
+    snprintf(t->sender_name, sizeof(t->sender_name), "%s", sender);
+    snprintf(t->path, sizeof(t->path), "%s", file_path);
+    t->last_progress = current_time_ms();
+    // chat_pump() hashes the file and sends the offer
+}
 
-        encoded[e++] = base64_table[b1>>2];
-        encoded[e++] = base64_table[((b1&3)<<4)|(b2>>4)];
-        encoded[e++] = (i+1<size) ? base64_table[((b2&15)<<2)|(b3>>6)] : '=';
-        encoded[e++] = (i+2<size) ? base64_table[b3&63] : '=';
+// Hashes the next slice of an outgoing file; offers it once the hash is done
+static void hash_and_offer(StickerTransfer *t)
+{
+    unsigned char buf[64 * 1024];
+    long budget = STICKER_HASH_SLICE;
+    fseek(t->fp, t->hashed, SEEK_SET);
+    while (budget > 0 && t->hashed < t->size) {
+        size_t n = fread(buf, 1, sizeof(buf), t->fp);
+        if (n == 0) break;
+        t->running = sticker_hash_update(t->running, buf, n);
+        t->hashed += (long)n;
+        budget -= (long)n;
     }
-    encoded[e] = 0;
+    t->last_progress = current_time_ms();
+    if (t->hashed < t->size) return;
 
-    char payload[65536];
+    t->hash = t->running;
+    t->offered = true;
+    char hex[17];
+    sticker_hash_format(t->hash, hex);
+    char payload[256];
     snprintf(payload, sizeof(payload),
         "sender_name: %s\n"
-        "content_type: STICKER\n"
-        "sticker_data: %s\n",
-        sender, encoded);
+        "sticker_id: %u\n"
+        "sticker_hash: %s\n"
+        "sticker_size: %ld\n"
+        "chunk_count: %d\n",
+        t->sender_name, t->id, hex, t->size, t->chunk_count);
+    net_send_game_message("STICKER_OFFER", payload);
+    printf("\r[CHAT] Sending sticker %s (%ld bytes, %d chunks)\n", t->path, t->size, t->chunk_count);
+}
 
-    net_send_game_message("CHAT_MESSAGE", payload);
+static void on_sticker_offer(const char *raw)
+{
+    NetSession *peer = net_active_session();
+    unsigned int id = (unsigned int)field_long(raw, "sticker_id", 0);
+    long size = field_long(raw, "sticker_size", 0);
+    int count = (int)field_long(raw, "chunk_count", 0);
+    const char *hex = find_field(raw, "sticker_hash");
+    StickerHash hash;
+    if (!peer || !hex || !sticker_hash_parse(hex, &hash) || size <= 0 || size > STICKER_MAX_BYTES
+        || count != (int)((size + STICKER_CHUNK_BYTES - 1) / STICKER_CHUNK_BYTES))
+        return;
+    if (find_transfer(peer, id, false)) return; // duplicate offer
+
+    char sender[64] = "";
+    const char *name = find_field(raw, "sender_name");
+    if (name) sscanf(name, "%63s", sender);
 
-    free(data);
-    free(encoded);
+    // Seen before: one ACK covering every chunk ends the transfer
+    char path[128];
+    if (sticker_cache_lookup(hash, path, sizeof(path))) {
+        send_ack(id, count, "cached: 1\n");
+        show_sticker(sender, path);
+        return;
+    }
+
+    StickerTransfer *t = alloc_transfer();
+    if (!t) {
+        printf("[CHAT] Too many incoming stickers, ignoring one\n");
+        return;
+    }
+    t->active = true;
+    t->id = id;
+    t->hash = hash;
+    t->running = STICKER_HASH_INIT;
+    t->peer = peer;
+    t->peer_id = net_session_id(peer);
+    t->size = size;
+    t->chunk_count = count;
+    snprintf(t->sender_name, sizeof(t->sender_name), "%s", sender);
+    sticker_cache_partial_path(hash, id, t->path, sizeof(t->path));
+    t->fp = fopen(t->path, "wb+");
+    t->have = calloc((count + 7) / 8, 1);
+    if (!t->fp || !t->have) {
+        end_transfer(t, false);
+        return;
+    }
+    t->last_progress = current_time_ms();
+    send_sticker_ack(t, false); // opens the window
+}
+
+static void on_sticker_chunk(const char *raw)
+{
+    StickerTransfer *t = find_transfer(net_active_session(), (unsigned int)field_long(raw, "sticker_id", 0), false);
+    const char *b64 = find_field(raw, "sticker_data");
+    int index = (int)field_long(raw, "chunk_index", -1);
+    if (!t || !b64 || index < 0 || index >= t->chunk_count) return;
+    if (t->have[index / 8] & (1 << (index % 8))) return; // resent after a resume
+
+    size_t b64_len = strcspn(b64, "\n");
+    if (b64_len > BASE64_ENCODED_LEN(STICKER_CHUNK_BYTES)) return;
+    unsigned char data[BASE64_DECODED_MAX(BASE64_ENCODED_LEN(STICKER_CHUNK_BYTES))];
+    Base64Decoder dec;
+    base64_decoder_init(&dec);
+    int n = (int)base64_decode_update(&dec, b64, b64_len, data);
+    long expect = index == t->chunk_count - 1 ? t->size - (long)index * STICKER_CHUNK_BYTES : STICKER_CHUNK_BYTES;
+    if (n != expect) return; // damaged; the resume path fetches it again
+
+    fseek(t->fp, (long)index * STICKER_CHUNK_BYTES, SEEK_SET);
+    fwrite(data, 1, n, t->fp);
+    t->have[index / 8] |= 1 << (index % 8);
+    t->last_progress = current_time_ms();
+    t->stalls = 0;
+
+    // The running hash covers the in-order prefix; chunks that arrived ahead
+    // of a gap are read back from disk when the gap fills
+    while (t->next_needed < t->chunk_count && (t->have[t->next_needed / 8] & (1 << (t->next_needed % 8)))) {
+        if (t->next_needed == index) {
+            t->running = sticker_hash_update(t->running, data, n);
+        } else {
+            unsigned char back[STICKER_CHUNK_BYTES];
+            fseek(t->fp, (long)t->next_needed * STICKER_CHUNK_BYTES, SEEK_SET);
+            size_t got = fread(back, 1, sizeof(back), t->fp);
+            t->running = sticker_hash_update(t->running, back, got);
+        }
+        t->next_needed++;
+        t->unacked++;
+    }
+
+    if (t->next_needed == t->chunk_count) {
+        send_sticker_ack(t, false);
+        fclose(t->fp);
+        t->fp = NULL;
+        char path[128];
+        if (sticker_cache_commit(t->hash, t->running, t->path, path, sizeof(path)))
+            show_sticker(t->sender_name, path);
+        else
+            printf("\r[CHAT] Sticker from %s failed its hash check, dropped\n", t->sender_name);
+        end_transfer(t, true);
+    } else if (t->unacked >= STICKER_WINDOW / 2) {
+        send_sticker_ack(t, false);
+    }
+}
+
+static void on_sticker_ack(const char *raw)
+{
+    StickerTransfer *t = find_transfer(net_active_session(), (unsigned int)field_long(raw, "sticker_id", 0), true);
+    if (!t) return;
+    int next = (int)field_long(raw, "next_chunk", 0);
+    if (next < 0 || next > t->chunk_count) return;
+
+    t->window_open = true;
+    if (next > t->acked) {
+        t->acked = next;
+        t->last_progress = current_time_ms();
+        t->stalls = 0;
+    }
+    // The receiver stalled: go back to the first chunk it lacks
+    if (find_field(raw, "resume") && next < t->next_send)
+        t->next_send = next;
+    if (t->next_send < t->acked)
+        t->next_send = t->acked;
+
+    if (t->acked == t->chunk_count) {
+        printf("\r[CHAT] Sticker %s delivered%s\n", t->path, find_field(raw, "cached") ? " (peer had it cached)" : "");
+        end_transfer(t, true);
+    }
+}
+
+void handle_sticker_message(MessageType type, const char *raw)
+{
+    switch (type) {
+    case MSG_STICKER_OFFER: on_sticker_offer(raw); break;
+    case MSG_STICKER_CHUNK: on_sticker_chunk(raw); break;
+    case MSG_STICKER_ACK: on_sticker_ack(raw); break;
+    default: break;
+    }
+}
+
+int chat_pump(void)
+{
+    NetSession *prev = net_active_session();
+    long long now = current_time_ms();
+    long long wake = -1;
+
+    for (int i = 0; i < STICKER_MAX_TRANSFERS; i++) {
+        StickerTransfer *t = &transfers[i];
+        if (!t->active) continue;
+        if (net_find_session_by_id(t->peer_id) != t->peer) {
+            printf("[CHAT] Sticker %s abandoned (peer gone)\n", t->path);
+            end_transfer(t, false);
+            continue;
+        }
+        net_select_session(t->peer);
+
+        if (t->outgoing && !t->offered) {
+            hash_and_offer(t);
+            wake = 0; // keep hashing without waiting on the socket
+            continue;
+        }
+
+        if (now - t->last_progress >= STICKER_STALL_MS) {
+            if (++t->stalls > STICKER_MAX_STALLS) {
+                printf("[CHAT] Sticker %s timed out\n", t->path);
+                end_transfer(t, false);
+                continue;
+            }
+            t->last_progress = now;
+            if (t->outgoing)
+                t->next_send = t->acked; // nothing acknowledged lately: resend the window
+            else
+                send_sticker_ack(t, true); // ask the sender to resume
+        }
+
+        // Fill the window; chunks ride the bulk lane, behind game and chat
+        if (t->outgoing && t->window_open) {
+            while (t->next_send < t->chunk_count && t->next_send < t->acked + STICKER_WINDOW
+                   && net_send_capacity(NET_LANE_BULK) > 0) {
+                if (!send_sticker_chunk(t, t->next_send)) break;
+                t->next_send++;
+            }
+        }
+
+        // Otherwise ACKs drive progress; wake only to spot a stall
+        long long until = t->last_progress + STICKER_STALL_MS - now;
+        if (until < 0) until = 0;
+        if (wake < 0 || until < wake) wake = until;
+    }
+
+    net_select_session(prev);
+    return (int)wake;
 }
 
 bool parse_chat_message(const char *raw, ChatMessage *out)
 {
+    PROFILE_SCOPE(PROF_PARSE_CHAT);
     memset(out, 0, sizeof(*out));
 
     if (!strstr(raw, "message_type: CHAT_MESSAGE"))
         return false;
 
-    char linebuf[60000];
-    strcpy(linebuf, raw);
+    char linebuf[4096];
+    snprintf(linebuf, sizeof(linebuf), "%s", raw);
 
-    char *line = strtok(linebuf, "\n");
+    char *save = NULL;
+    char *line = strtok_r(linebuf, "\n", &save);
     while (line) {
         if (strncmp(line, "sender_name:", 12) == 0)
             sscanf(line+12, "%63s", out->sender_name);
@@ -111,19 +431,12 @@ bool parse_chat_message(const char *raw, ChatMessage *out)
         }
 
         else if (strncmp(line, "message_text:", 13) == 0)
-            strncpy(out->message_text, line+13, sizeof(out->message_text));
-
-        else if (strncmp(line, "sticker_data:", 13) == 0) {
-            char *b64 = line + 13;
-            snprintf(out->sticker_filename, sizeof(out->sticker_filename),
-                     "received_sticker_%d.png", out->sequence_number);
-            decode_base64(b64, out->sticker_filename);
-        }
+            strncpy(out->message_text, line+13, sizeof(out->message_text) - 1);
 
         else if (strncmp(line, "sequence_number:", 16) == 0)
             out->sequence_number = atoi(line+16);
 
-        line = strtok(NULL, "\n");
+        line = strtok_r(NULL, "\n", &save);
     }
 
     return true;
@@ -2,6 +2,16 @@
 #define CHAT_H
 
 #include <stdbool.h>
+#include "game_logic.h"
+
+// --- Sticker Streaming ---
+#define STICKER_CHUNK_BYTES 768      // 1024 base64 chars: one chunk per NET_MTU datagram
+#define STICKER_WINDOW 16            // chunks in flight per transfer
+#define STICKER_STALL_MS 1500        // no progress for this long triggers a resume
+#define STICKER_MAX_STALLS 5
+#define STICKER_MAX_TRANSFERS 8
+#define STICKER_HASH_SLICE (1024 * 1024) // bytes hashed per chat_pump() before offering
+#define STICKER_MAX_BYTES (16L * 1024 * 1024)
 
 typedef enum {
     CHAT_TEXT,
@@ -16,8 +26,13 @@ typedef struct {
     int sequence_number;
 } ChatMessage;
 
-void send_chat_text(const char *sender, const char *text);
+// Offers a file to the active session and streams it from chat_pump()
 void send_chat_sticker(const char *sender, const char *file_path);
+// STICKER_OFFER / STICKER_CHUNK / STICKER_ACK from the active session
+void handle_sticker_message(MessageType type, const char *raw);
+// Call every loop: fills send windows and resumes stalled transfers.
+// Returns how soon (ms) it wants to run again, -1 if only traffic matters.
+int chat_pump(void);
 
 bool parse_chat_message(const char *raw, ChatMessage *out);
 void display_chat_message(const ChatMessage *msg);
@@ -1,5 +1,6 @@
 // damage_calc.c
 #include "damage_calc.h"
+#include "profile.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -235,6 +236,7 @@ float get_type_multiplier(const char *move_type, const char *def_type1, const ch
 // ---- Load Pokémon CSV ----
 void load_pokemon_data(const char *csv_path)
 {
+    PROFILE_SCOPE(PROF_LOAD_POKEMON);
     FILE *file = open_pokemon_csv(csv_path);
     if (!file)
     { // fallback
@@ -396,6 +398,7 @@ int apply_boost(int base_stat, int boost_stage)
 
 DamageResult calculate_damage_logic(const char *attacker_name, const char *defender_name, const char *move_name)
 {
+    PROFILE_SCOPE(PROF_CALCULATE_DAMAGE);
     DamageResult out;
     memset(&out, 0, sizeof(out));
     out.damage_dealt = 0;
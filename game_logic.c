@@ -1,23 +1,26 @@
 #include "game_logic.h"
 #include "damage_calc.h"
+#include "journal.h"
+#include "metrics.h"
+#include "log.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 
-#ifdef _WIN32
-#include <windows.h>
-#define sleep_ms_logic(x) Sleep(x)
-#else
-#include <unistd.h>
-#define sleep_ms_logic(x) usleep((x) * 1000)
-#endif
-
 extern void network_send_message(const char *msg);
 extern int network_get_next_sequence(void);
 
-unsigned int shared_rng_seed = 0;
-void set_shared_rng_seed(unsigned int seed) { shared_rng_seed = seed; }
+// Server workers resolve turns concurrently, so these are bumped atomically
+static ResolutionStats resolution_stats;
+
+// Every message the battle logic sends goes through here, so the journal
+// sees the outgoing half of the stream too
+static void send_game_payload(const BattleContext *ctx, MessageType type, const char *payload)
+{
+    journal_record_message(ctx->journal, JOURNAL_OUT, type, payload, strlen(payload));
+    network_send_message(payload);
+}
 
 void init_battle(BattleContext *ctx, PlayerRole role, const char *pokemon_name)
 {
@@ -28,6 +31,13 @@ void init_battle(BattleContext *ctx, PlayerRole role, const char *pokemon_name)
     load_moves_from_pokemon();
     // 3. (Optional, Removed) load_moves_csv("moves.csv"); - No longer needed as abilities serve as moves.
 
+    init_battle_state(ctx, role, pokemon_name);
+    LOG_INFO("[LOGIC] Battle Init. Me: %s (%d HP). State: SETUP\n", ctx->my_pokemon, ctx->my_hp);
+}
+
+// Resets a context without reloading the databases (one per server session)
+void init_battle_state(BattleContext *ctx, PlayerRole role, const char *pokemon_name)
+{
     memset(ctx, 0, sizeof(BattleContext));
     ctx->my_role = role;
     strncpy(ctx->my_pokemon, pokemon_name, 31);
@@ -36,7 +46,70 @@ void init_battle(BattleContext *ctx, PlayerRole role, const char *pokemon_name)
     ctx->opponent_hp = 100;
     ctx->state = STATE_SETUP;
     ctx->is_my_turn = (role == ROLE_HOST);
-    printf("[LOGIC] Battle Init. Me: %s (%d HP). State: SETUP\n", ctx->my_pokemon, ctx->my_hp);
+}
+
+bool battle_awaiting_opponent(const BattleContext *ctx)
+{
+    if (ctx->my_role == ROLE_SPECTATOR)
+        return false;
+    if (ctx->state == STATE_PROCESSING_TURN)
+        return true;
+    return ctx->state == STATE_WAITING_FOR_MOVE && !ctx->is_my_turn;
+}
+
+// --- State Digest ---
+// FNV-1a over a canonical view: the host's Pokémon is always P1, so both
+// peers fold identical bytes even though their "my"/"opponent" slots differ.
+#define DIGEST_OFFSET 0xcbf29ce484222325ULL
+#define DIGEST_PRIME 0x100000001b3ULL
+
+static uint64_t digest_bytes(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= DIGEST_PRIME;
+    }
+    return h;
+}
+
+static uint64_t digest_str(uint64_t h, const char *s)
+{
+    return digest_bytes(h, s, strlen(s) + 1); // the NUL keeps fields apart
+}
+
+static uint64_t digest_int(uint64_t h, int v)
+{
+    unsigned char b[4] = {(unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24)};
+    return digest_bytes(h, b, sizeof(b));
+}
+
+// Folds species and HP of both sides, host first
+static uint64_t digest_sides(uint64_t h, const BattleContext *ctx)
+{
+    bool host = ctx->my_role == ROLE_HOST;
+    h = digest_str(h, host ? ctx->my_pokemon : ctx->opponent_pokemon);
+    h = digest_int(h, host ? ctx->my_hp : ctx->opponent_hp);
+    h = digest_str(h, host ? ctx->opponent_pokemon : ctx->my_pokemon);
+    return digest_int(h, host ? ctx->opponent_hp : ctx->my_hp);
+}
+
+// Each turn folds in what happened (who attacked with what, for how much)
+// and the HP it left behind, so the 8 bytes cover the whole history
+static void digest_turn(BattleContext *ctx)
+{
+    bool host_attacked = (strcmp(ctx->current_attacker, ctx->my_pokemon) == 0) == (ctx->my_role == ROLE_HOST);
+    uint64_t h = digest_int(ctx->state_digest, (int)ctx->turn_number);
+    h = digest_int(h, host_attacked ? 1 : 2);
+    h = digest_str(h, ctx->current_move);
+    h = digest_int(h, ctx->local_calc_result.damage_dealt);
+    ctx->state_digest = digest_sides(h, ctx);
+}
+
+void format_state_digest(uint64_t digest, char out[17])
+{
+    snprintf(out, 17, "%016llx", (unsigned long long)digest);
 }
 
 void perform_turn_calculation(BattleContext *ctx)
@@ -48,6 +121,7 @@ void perform_turn_calculation(BattleContext *ctx)
     const char *attacker = i_am_attacker ? ctx->my_pokemon : ctx->opponent_pokemon;
     const char *defender = i_am_attacker ? ctx->opponent_pokemon : ctx->my_pokemon;
     int current_def_hp = i_am_attacker ? ctx->opponent_hp : ctx->my_hp;
+    ctx->turn_defender_hp = current_def_hp;
 
     DamageResult res = calculate_damage_logic(attacker, defender, ctx->current_move);
     int new_hp = current_def_hp - res.damage_dealt;
@@ -57,8 +131,8 @@ void perform_turn_calculation(BattleContext *ctx)
     ctx->local_calc_result = res;
     ctx->local_calc_result.defender_remaining_hp = new_hp;
 
-    printf("[LOGIC] Calc: %s used %s on %s. Dmg: %d, OldHP: %d, NewHP: %d\n",
-           attacker, ctx->current_move, defender, res.damage_dealt, current_def_hp, new_hp);
+    LOG_INFO("[LOGIC] Calc: %s used %s on %s. Dmg: %d, OldHP: %d, NewHP: %d\n",
+             attacker, ctx->current_move, defender, res.damage_dealt, current_def_hp, new_hp);
 
     char payload[512];
     snprintf(payload, sizeof(payload),
@@ -66,20 +140,28 @@ void perform_turn_calculation(BattleContext *ctx)
              "attacker: %s\nmove_used: %s\ndamage_dealt: %d\ndefender_hp_remaining: %d\n"
              "sequence_number: %d\n",
              ctx->current_attacker, ctx->current_move, res.damage_dealt, new_hp, network_get_next_sequence());
-    network_send_message(payload);
+    send_game_payload(ctx, MSG_CALCULATION_REPORT, payload);
 }
 
 void finalize_turn(BattleContext *ctx)
 {
+    ctx->turn_number++;
+    if (ctx->turn_started_us)
+    {
+        metrics_observe(METRIC_TURN_TIME, metrics_now_us() - ctx->turn_started_us);
+        metrics_add(METRIC_TURNS, 1);
+        ctx->turn_started_us = 0;
+    }
+    digest_turn(ctx);
     if (ctx->opponent_hp <= 0 || ctx->my_hp <= 0)
     {
         ctx->state = STATE_GAME_OVER;
-        printf("[LOGIC] GAME OVER. Me: %d, Opp: %d\n", ctx->my_hp, ctx->opponent_hp);
+        LOG_INFO("[LOGIC] GAME OVER. Me: %d, Opp: %d\n", ctx->my_hp, ctx->opponent_hp);
         return;
     }
     ctx->is_my_turn = !ctx->is_my_turn;
     ctx->state = STATE_WAITING_FOR_MOVE;
-    printf("[LOGIC] Turn End. Next: %s\n", ctx->is_my_turn ? "MY TURN" : "OPPONENT");
+    LOG_DEBUG("[LOGIC] Turn End. Next: %s\n", ctx->is_my_turn ? "MY TURN" : "OPPONENT");
 }
 
 void handle_battle_setup(BattleContext *ctx, GameMessage *msg)
@@ -90,8 +172,10 @@ void handle_battle_setup(BattleContext *ctx, GameMessage *msg)
         const PokemonData *opp = get_pokemon(ctx->opponent_pokemon);
         if (opp)
             ctx->opponent_hp = opp->hp;
-        printf("[LOGIC] Opponent is %s (%d HP)\n", ctx->opponent_pokemon, ctx->opponent_hp);
+        LOG_INFO("[LOGIC] Opponent is %s (%d HP)\n", ctx->opponent_pokemon, ctx->opponent_hp);
         ctx->state = STATE_WAITING_FOR_MOVE;
+        ctx->turn_number = 0;
+        ctx->state_digest = digest_sides(DIGEST_OFFSET, ctx);
     }
 }
 
@@ -102,17 +186,124 @@ void handle_attack_announce(BattleContext *ctx, GameMessage *msg)
 
     strncpy(ctx->current_move, msg->move_name, 31);
     strncpy(ctx->current_attacker, ctx->opponent_pokemon, 31);
-    printf("[LOGIC] Opponent attacks with %s\n", msg->move_name);
+    LOG_INFO("[LOGIC] Opponent attacks with %s\n", msg->move_name);
+    ctx->turn_started_us = metrics_now_us();
     ctx->state = STATE_PROCESSING_TURN;
     perform_turn_calculation(ctx);
 }
 
+// --- Discrepancy Resolution ---
+// The inputs that fully determine a hit. Boosts and the RNG counter travel
+// too so a future calc that uses them resolves the same way.
+typedef struct
+{
+    char attacker[32];
+    char defender[32];
+    char move[32];
+    int attacker_boost;
+    int defender_boost;
+    unsigned int rng_seed;
+    int defender_hp; // before the hit
+} TurnInputs;
+
+static void local_turn_inputs(const BattleContext *ctx, TurnInputs *in)
+{
+    bool i_am_attacker = strcmp(ctx->current_attacker, ctx->my_pokemon) == 0;
+    strncpy(in->attacker, ctx->current_attacker, 31);
+    in->attacker[31] = '\0';
+    strncpy(in->defender, i_am_attacker ? ctx->opponent_pokemon : ctx->my_pokemon, 31);
+    in->defender[31] = '\0';
+    strncpy(in->move, ctx->current_move, 31);
+    in->move[31] = '\0';
+    in->attacker_boost = 0;
+    in->defender_boost = 0;
+    in->rng_seed = ctx->rng_seed;
+    in->defender_hp = ctx->turn_defender_hp;
+}
+
+// One line, like the snapshot: attacker|defender|move|atk_boost|def_boost|rng|def_hp
+static bool parse_turn_inputs(const char *raw, TurnInputs *in)
+{
+    const char *p = strstr(raw, "inputs: ");
+    return p && sscanf(p + 8, "%31[^|]|%31[^|]|%31[^|]|%d|%d|%u|%d", in->attacker, in->defender, in->move,
+                       &in->attacker_boost, &in->defender_boost, &in->rng_seed, &in->defender_hp) == 7;
+}
+
+static void send_resolution_request(BattleContext *ctx)
+{
+    TurnInputs in;
+    local_turn_inputs(ctx, &in);
+    ctx->awaiting_resolution = true;
+    __atomic_fetch_add(&resolution_stats.requested, 1, __ATOMIC_RELAXED);
+    LOG_WARN("[LOGIC] Reports disagree, requesting resolution\n");
+
+    char payload[384];
+    snprintf(payload, sizeof(payload),
+             "message_type: RESOLUTION_REQUEST\n"
+             "inputs: %s|%s|%s|%d|%d|%u|%d\n"
+             "damage_dealt: %d\n"
+             "sequence_number: %d\n",
+             in.attacker, in.defender, in.move, in.attacker_boost, in.defender_boost, in.rng_seed,
+             in.defender_hp, ctx->local_calc_result.damage_dealt, network_get_next_sequence());
+    send_game_payload(ctx, MSG_RESOLUTION_REQUEST, payload);
+}
+
+static void send_calculation_confirm(BattleContext *ctx);
+
+// Both sides sent a request, so each now holds the host's inputs and
+// recomputes the same hit; no further round trip is needed
+void handle_resolution_request(BattleContext *ctx, GameMessage *msg)
+{
+    TurnInputs theirs, in;
+    if (!ctx->awaiting_resolution || !parse_turn_inputs(msg->raw_buffer, &theirs))
+        return;
+    if (ctx->my_role == ROLE_HOST)
+        local_turn_inputs(ctx, &in);
+    else
+        in = theirs;
+
+    DamageResult res = calculate_damage_logic(in.attacker, in.defender, in.move);
+    int new_hp = in.defender_hp - res.damage_dealt;
+    if (new_hp < 0)
+        new_hp = 0;
+    res.defender_remaining_hp = new_hp;
+
+    if (res.damage_dealt != ctx->local_calc_result.damage_dealt ||
+        new_hp != ctx->local_calc_result.defender_remaining_hp)
+        __atomic_fetch_add(&resolution_stats.corrected, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&resolution_stats.resolved, 1, __ATOMIC_RELAXED);
+    LOG_INFO("[LOGIC] Resolved: %s used %s on %s. Dmg: %d, NewHP: %d (mine was %d, peer's %d)\n",
+             in.attacker, in.move, in.defender, res.damage_dealt, new_hp,
+             ctx->local_calc_result.damage_dealt, msg->damage_dealt);
+
+    ctx->awaiting_resolution = false;
+    ctx->local_calc_result = res;
+    strncpy(ctx->current_attacker, in.attacker, 31);
+    strncpy(ctx->current_move, in.move, 31);
+    if (strcmp(in.attacker, ctx->my_pokemon) == 0)
+        ctx->opponent_hp = new_hp;
+    else
+        ctx->my_hp = new_hp;
+
+    finalize_turn(ctx);
+    send_calculation_confirm(ctx);
+}
+
+ResolutionStats get_resolution_stats(void)
+{
+    ResolutionStats s;
+    s.requested = __atomic_load_n(&resolution_stats.requested, __ATOMIC_RELAXED);
+    s.resolved = __atomic_load_n(&resolution_stats.resolved, __ATOMIC_RELAXED);
+    s.corrected = __atomic_load_n(&resolution_stats.corrected, __ATOMIC_RELAXED);
+    return s;
+}
+
 void handle_calculation_report(BattleContext *ctx, GameMessage *msg)
 {
     // --- SAFETY: Catch-up if we missed ATTACK_ANNOUNCE ---
     if (ctx->state == STATE_WAITING_FOR_MOVE && strcmp(msg->attacker, ctx->opponent_pokemon) == 0)
     {
-        printf("[LOGIC] Warning: Missed ATTACK_ANNOUNCE. Catching up state...\n");
+        LOG_WARN("[LOGIC] Warning: Missed ATTACK_ANNOUNCE. Catching up state...\n");
         strncpy(ctx->current_attacker, msg->attacker, 31);
         strncpy(ctx->current_move, msg->move_name, 31); // Use move_name from struct
         ctx->state = STATE_PROCESSING_TURN;
@@ -120,12 +311,16 @@ void handle_calculation_report(BattleContext *ctx, GameMessage *msg)
         // We just ran our calc, now we continue to compare
     }
 
-    printf("[LOGIC] Report Check. Me: Dmg %d | Opp: Dmg %d\n",
-           ctx->local_calc_result.damage_dealt, msg->damage_dealt);
+    LOG_DEBUG("[LOGIC] Report Check. Me: Dmg %d | Opp: Dmg %d\n",
+              ctx->local_calc_result.damage_dealt, msg->damage_dealt);
 
-    char payload[256];
-    snprintf(payload, sizeof(payload), "message_type: CALCULATION_CONFIRM\nsequence_number: %d\n", network_get_next_sequence());
-    network_send_message(payload);
+    if (msg->damage_dealt != ctx->local_calc_result.damage_dealt ||
+        msg->defender_hp_remaining != ctx->local_calc_result.defender_remaining_hp)
+    {
+        // Don't trust either number: swap inputs and settle on one result
+        send_resolution_request(ctx);
+        return;
+    }
 
     if (strcmp(msg->attacker, ctx->my_pokemon) == 0)
         ctx->opponent_hp = msg->defender_hp_remaining;
@@ -133,6 +328,181 @@ void handle_calculation_report(BattleContext *ctx, GameMessage *msg)
         ctx->my_hp = msg->defender_hp_remaining;
 
     finalize_turn(ctx);
+    send_calculation_confirm(ctx);
+}
+
+// The confirm carries where the turn left us; the peer checks it against its
+// own digest
+static void send_calculation_confirm(BattleContext *ctx)
+{
+    char digest[17];
+    format_state_digest(ctx->state_digest, digest);
+    char payload[256];
+    snprintf(payload, sizeof(payload),
+             "message_type: CALCULATION_CONFIRM\nturn_number: %u\nstate_digest: %s\nsequence_number: %d\n",
+             ctx->turn_number, digest, network_get_next_sequence());
+    send_game_payload(ctx, MSG_CALCULATION_CONFIRM, payload);
+}
+
+// Desync check: the peer's confirm for a turn must match our own digest. The
+// host is authoritative and answers a mismatch with a full snapshot, which
+// the joiner adopts.
+void handle_calculation_confirm(BattleContext *ctx, GameMessage *msg)
+{
+    if (msg->state_digest[0] == '\0')
+        return; // older peer: nothing to compare
+
+    char mine[17];
+    format_state_digest(ctx->state_digest, mine);
+    if (msg->turn_number == ctx->turn_number && strcmp(msg->state_digest, mine) == 0)
+        return;
+
+    LOG_WARN("[LOGIC] Desync at turn %u: peer %s (turn %u), me %s\n",
+             ctx->turn_number, msg->state_digest, msg->turn_number, mine);
+    if (ctx->my_role == ROLE_HOST)
+        send_battle_snapshot(ctx, 0);
+}
+
+// --- Spectator View ---
+// Spectators see both players' messages (origin says whose). P1 is the host,
+// kept in the "my" slots; P2 is the joiner, kept in the "opponent" slots.
+// is_my_turn means "P1's turn".
+void handle_spectator_event(BattleContext *ctx, GameMessage *msg)
+{
+    bool from_host = strcmp(msg->origin, "host") == 0;
+
+    switch (msg->type)
+    {
+    case MSG_BATTLE_SETUP:
+    {
+        char *slot = from_host ? ctx->my_pokemon : ctx->opponent_pokemon;
+        int *hp = from_host ? &ctx->my_hp : &ctx->opponent_hp;
+        strncpy(slot, msg->attacker, 31);
+        const PokemonData *p = get_pokemon(slot);
+        *hp = p ? p->hp : 100;
+        ctx->is_my_turn = true; // host opens
+        ctx->state = STATE_WAITING_FOR_MOVE;
+        break;
+    }
+    case MSG_ATTACK_ANNOUNCE:
+        strncpy(ctx->current_move, msg->move_name, 31);
+        strncpy(ctx->current_attacker, from_host ? ctx->my_pokemon : ctx->opponent_pokemon, 31);
+        ctx->state = STATE_PROCESSING_TURN;
+        LOG_INFO("[SPECTATE] %s uses %s\n", ctx->current_attacker, ctx->current_move);
+        break;
+    case MSG_CALCULATION_REPORT:
+    {
+        // Both players report the same turn; applying it twice is harmless
+        bool p1_attacked = strcmp(msg->attacker, ctx->my_pokemon) == 0;
+        if (p1_attacked)
+            ctx->opponent_hp = msg->defender_hp_remaining;
+        else
+            ctx->my_hp = msg->defender_hp_remaining;
+        ctx->is_my_turn = !p1_attacked;
+        ctx->state = (ctx->my_hp <= 0 || ctx->opponent_hp <= 0) ? STATE_GAME_OVER : STATE_WAITING_FOR_MOVE;
+        break;
+    }
+    case MSG_RESOLUTION_REQUEST:
+    {
+        // The host's inputs are what both players settle on; redo its hit
+        TurnInputs in;
+        if (!from_host || !parse_turn_inputs(msg->raw_buffer, &in))
+            break;
+        DamageResult res = calculate_damage_logic(in.attacker, in.defender, in.move);
+        int new_hp = in.defender_hp - res.damage_dealt;
+        if (new_hp < 0)
+            new_hp = 0;
+        if (strcmp(in.defender, ctx->my_pokemon) == 0)
+            ctx->my_hp = new_hp;
+        else
+            ctx->opponent_hp = new_hp;
+        ctx->state = (ctx->my_hp <= 0 || ctx->opponent_hp <= 0) ? STATE_GAME_OVER : STATE_WAITING_FOR_MOVE;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Snapshot line: p1|p1_hp|p2|p2_hp|p1_turn|state|event_seq, from the host's
+// point of view (its "my" slots are P1)
+void send_battle_snapshot(const BattleContext *battle, unsigned int event_seq)
+{
+    char digest[17];
+    format_state_digest(battle->state_digest, digest);
+    char payload[320];
+    snprintf(payload, sizeof(payload),
+             "message_type: BATTLE_SNAPSHOT\n"
+             "snapshot: %s|%d|%s|%d|%d|%d|%u\n"
+             "turn_number: %u\n"
+             "state_digest: %s\n"
+             "sequence_number: %d\n",
+             battle->my_pokemon, battle->my_hp,
+             battle->opponent_pokemon, battle->opponent_hp,
+             battle->is_my_turn ? 1 : 0, (int)battle->state, event_seq,
+             battle->turn_number, digest,
+             network_get_next_sequence());
+    send_game_payload(battle, MSG_BATTLE_SNAPSHOT, payload);
+}
+
+bool apply_battle_snapshot(BattleContext *ctx, const char *raw)
+{
+    const char *p = strstr(raw, "snapshot: ");
+    if (!p)
+        return false;
+    char p1[32], p2[32];
+    int p1_hp, p2_hp, p1_turn, state;
+    unsigned int event_seq;
+    if (sscanf(p + 10, "%31[^|]|%d|%31[^|]|%d|%d|%d|%u",
+               p1, &p1_hp, p2, &p2_hp, &p1_turn, &state, &event_seq) != 7)
+        return false;
+    if (event_seq < ctx->last_event_seq)
+        return false; // older than what the feed already delivered
+
+    strncpy(ctx->my_pokemon, p1, 31);
+    strncpy(ctx->opponent_pokemon, p2, 31);
+    ctx->my_hp = p1_hp;
+    ctx->opponent_hp = p2_hp;
+    ctx->is_my_turn = p1_turn != 0;
+    ctx->state = (BattleState)state;
+    ctx->last_event_seq = event_seq;
+    LOG_INFO("[SPECTATE] Caught up at event %u\n", event_seq);
+    return true;
+}
+
+// Joiner side of a desync: take the host's sides, mirrored into our slots.
+// Whose turn it is stays with the message flow, which both peers agree on.
+static bool resync_from_snapshot(BattleContext *ctx, GameMessage *msg)
+{
+    const char *p = strstr(msg->raw_buffer, "snapshot: ");
+    unsigned long long digest;
+    if (!p || msg->state_digest[0] == '\0' || sscanf(msg->state_digest, "%16llx", &digest) != 1)
+        return false;
+    if (msg->turn_number < ctx->turn_number)
+        return false; // taken before a turn we've since finished; a newer one follows
+    char p1[32], p2[32];
+    int p1_hp, p2_hp, p1_turn, state;
+    if (sscanf(p + 10, "%31[^|]|%d|%31[^|]|%d|%d|%d", p1, &p1_hp, p2, &p2_hp, &p1_turn, &state) != 6)
+        return false;
+
+    strncpy(ctx->opponent_pokemon, p1, 31);
+    strncpy(ctx->my_pokemon, p2, 31);
+    ctx->opponent_hp = p1_hp;
+    ctx->my_hp = p2_hp;
+    if (p1_hp <= 0 || p2_hp <= 0)
+        ctx->state = STATE_GAME_OVER;
+    ctx->turn_number = msg->turn_number;
+    ctx->state_digest = digest;
+    LOG_INFO("[LOGIC] Resynced to host at turn %u. Me: %d, Opp: %d\n", ctx->turn_number, ctx->my_hp, ctx->opponent_hp);
+    return true;
+}
+
+static void handle_battle_snapshot(BattleContext *ctx, GameMessage *msg)
+{
+    if (ctx->my_role == ROLE_SPECTATOR)
+        apply_battle_snapshot(ctx, msg->raw_buffer);
+    else if (ctx->my_role == ROLE_CLIENT)
+        resync_from_snapshot(ctx, msg);
 }
 
 void execute_move_command(BattleContext *ctx, const char *move_name)
@@ -140,6 +510,7 @@ void execute_move_command(BattleContext *ctx, const char *move_name)
     if (!ctx->is_my_turn || ctx->state != STATE_WAITING_FOR_MOVE)
         return;
 
+    journal_record_move(ctx->journal, move_name);
     strncpy(ctx->current_move, move_name, 31);
     strncpy(ctx->current_attacker, ctx->my_pokemon, 31);
 
@@ -147,20 +518,113 @@ void execute_move_command(BattleContext *ctx, const char *move_name)
     snprintf(payload, sizeof(payload),
              "message_type: ATTACK_ANNOUNCE\nmove_name: %s\nsequence_number: %d\n",
              move_name, network_get_next_sequence());
-    network_send_message(payload);
+    send_game_payload(ctx, MSG_ATTACK_ANNOUNCE, payload);
 
-    sleep_ms_logic(100); // Prevent packet storm race condition
+    // Frames are delivered in order, so the report can follow right away
+    ctx->turn_started_us = metrics_now_us();
     ctx->state = STATE_PROCESSING_TURN;
     perform_turn_calculation(ctx);
+    journal_record_state(ctx->journal, ctx);
+}
+
+// --- Message Dispatch ---
+static const char *MESSAGE_TYPE_NAMES[MSG_TYPE_COUNT] = {
+    [MSG_UNKNOWN] = "UNKNOWN",
+    [MSG_HANDSHAKE_REQUEST] = "HANDSHAKE_REQUEST",
+    [MSG_HANDSHAKE_RESPONSE] = "HANDSHAKE_RESPONSE",
+    [MSG_SPECTATOR_REQUEST] = "SPECTATOR_REQUEST",
+    [MSG_BATTLE_SETUP] = "BATTLE_SETUP",
+    [MSG_ATTACK_ANNOUNCE] = "ATTACK_ANNOUNCE",
+    [MSG_DEFENSE_ANNOUNCE] = "DEFENSE_ANNOUNCE",
+    [MSG_CALCULATION_REPORT] = "CALCULATION_REPORT",
+    [MSG_CALCULATION_CONFIRM] = "CALCULATION_CONFIRM",
+    [MSG_RESOLUTION_REQUEST] = "RESOLUTION_REQUEST",
+    [MSG_GAME_OVER] = "GAME_OVER",
+    [MSG_CHAT_MESSAGE] = "CHAT_MESSAGE",
+    [MSG_ACK] = "ACK",
+    [MSG_BATTLE_SNAPSHOT] = "BATTLE_SNAPSHOT",
+    [MSG_SNAPSHOT_REQUEST] = "SNAPSHOT_REQUEST",
+    [MSG_STICKER_OFFER] = "STICKER_OFFER",
+    [MSG_STICKER_CHUNK] = "STICKER_CHUNK",
+    [MSG_STICKER_ACK] = "STICKER_ACK",
+};
+
+// Game handlers are registered up front; other modules (handshake, chat)
+// add theirs through register_message_handler().
+// REMOVED finalize_turn from CALCULATION_CONFIRM to prevent Double Toggle bug
+static MessageHandler message_handlers[MSG_TYPE_COUNT] = {
+    [MSG_BATTLE_SETUP] = handle_battle_setup,
+    [MSG_ATTACK_ANNOUNCE] = handle_attack_announce,
+    [MSG_CALCULATION_REPORT] = handle_calculation_report,
+    [MSG_CALCULATION_CONFIRM] = handle_calculation_confirm,
+    [MSG_RESOLUTION_REQUEST] = handle_resolution_request,
+    [MSG_BATTLE_SNAPSHOT] = handle_battle_snapshot,
+};
+
+MessageType message_type_from_string(const char *name)
+{
+    if (!name || !*name)
+        return MSG_UNKNOWN;
+    for (int i = 1; i < MSG_TYPE_COUNT; i++)
+        if (name[0] == MESSAGE_TYPE_NAMES[i][0] && strcmp(name, MESSAGE_TYPE_NAMES[i]) == 0)
+            return (MessageType)i;
+    return MSG_UNKNOWN;
+}
+
+const char *message_type_name(MessageType type)
+{
+    if (type < 0 || type >= MSG_TYPE_COUNT)
+        return MESSAGE_TYPE_NAMES[MSG_UNKNOWN];
+    return MESSAGE_TYPE_NAMES[type];
+}
+
+void register_message_handler(MessageType type, MessageHandler handler)
+{
+    if (type <= MSG_UNKNOWN || type >= MSG_TYPE_COUNT)
+        return;
+    message_handlers[type] = handler;
+}
+
+static void dispatch_message(BattleContext *ctx, GameMessage *msg)
+{
+    if (ctx->my_role == ROLE_SPECTATOR && msg->event_seq != 0)
+    {
+        // Feed events the snapshot already covers are stale
+        if (msg->event_seq <= ctx->last_event_seq)
+            return;
+        // The feed is unreliable: after a gap, ask for a fresh snapshot
+        // (later events still apply; the snapshot overwrites what they touched)
+        if (ctx->last_event_seq != 0 && msg->event_seq != ctx->last_event_seq + 1)
+        {
+            LOG_INFO("[SPECTATE] Missed events %u-%u, resyncing\n", ctx->last_event_seq + 1, msg->event_seq - 1);
+            char payload[128];
+            snprintf(payload, sizeof(payload), "message_type: SNAPSHOT_REQUEST\nsequence_number: %d\n", network_get_next_sequence());
+            send_game_payload(ctx, MSG_SNAPSHOT_REQUEST, payload);
+        }
+        ctx->last_event_seq = msg->event_seq;
+    }
+    if (ctx->my_role == ROLE_SPECTATOR && msg->type >= MSG_BATTLE_SETUP && msg->type <= MSG_GAME_OVER)
+    {
+        handle_spectator_event(ctx, msg);
+        return;
+    }
+    MessageHandler handler = message_handlers[msg->type];
+    if (handler)
+        handler(ctx, msg);
 }
 
 void process_incoming_message(BattleContext *ctx, GameMessage *msg)
 {
-    if (strcmp(msg->message_type, "BATTLE_SETUP") == 0)
-        handle_battle_setup(ctx, msg);
-    else if (strcmp(msg->message_type, "ATTACK_ANNOUNCE") == 0)
-        handle_attack_announce(ctx, msg);
-    else if (strcmp(msg->message_type, "CALCULATION_REPORT") == 0)
-        handle_calculation_report(ctx, msg);
-    // REMOVED finalize_turn from CALCULATION_CONFIRM to prevent Double Toggle bug
+    if (msg->type <= MSG_UNKNOWN || msg->type >= MSG_TYPE_COUNT)
+        return;
+    // Per battle: server workers and verifier threads run many at once
+    if (msg->has_seed)
+        ctx->rng_seed = msg->seed;
+    // Sticker chunks are bulk data, not battle history
+    bool journaled = ctx->journal && msg->type != MSG_STICKER_CHUNK && msg->type != MSG_STICKER_ACK;
+    if (journaled)
+        journal_record_message(ctx->journal, JOURNAL_IN, msg->type, msg->raw_buffer, strlen(msg->raw_buffer));
+    dispatch_message(ctx, msg);
+    if (journaled)
+        journal_record_state(ctx->journal, ctx);
 }
\ No newline at end of file
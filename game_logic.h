@@ -3,9 +3,13 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include "damage_calc.h" // Include first to avoid DamageResult conflicts
 
+// How long the opponent may keep the battle waiting before forfeiting
+#define TURN_TIMEOUT_MS 120000
+
 typedef enum
 {
     STATE_SETUP,
@@ -21,17 +25,51 @@ typedef enum
     ROLE_SPECTATOR
 } PlayerRole;
 
+// Message types are decoded once in parse_kv() so routing is a table lookup
+typedef enum
+{
+    MSG_UNKNOWN = 0,
+    MSG_HANDSHAKE_REQUEST,
+    MSG_HANDSHAKE_RESPONSE,
+    MSG_SPECTATOR_REQUEST,
+    MSG_BATTLE_SETUP,
+    MSG_ATTACK_ANNOUNCE,
+    MSG_DEFENSE_ANNOUNCE,
+    MSG_CALCULATION_REPORT,
+    MSG_CALCULATION_CONFIRM,
+    MSG_RESOLUTION_REQUEST,
+    MSG_GAME_OVER,
+    MSG_CHAT_MESSAGE,
+    MSG_ACK,
+    MSG_BATTLE_SNAPSHOT,
+    MSG_SNAPSHOT_REQUEST,
+    MSG_STICKER_OFFER,
+    MSG_STICKER_CHUNK,
+    MSG_STICKER_ACK,
+    MSG_TYPE_COUNT
+} MessageType;
+
 typedef struct
 {
+    MessageType type;
     char message_type[32];
     char move_name[32];
     char attacker[32]; // <--- FIX: missing attribute
     int damage_dealt;
     int defender_hp_remaining;
     char winner[32];
+    unsigned int event_seq;  // spectator feed only
+    char origin[16];         // spectator feed: "host" or "joiner"
+    unsigned int battle_id;  // SPECTATOR_REQUEST: which battle to watch
+    unsigned int turn_number; // CALCULATION_CONFIRM / BATTLE_SNAPSHOT
+    char state_digest[17];    // hex, empty if the peer didn't send one
+    bool has_seed;            // HANDSHAKE_RESPONSE: the host's RNG seed
+    unsigned int seed;
     char raw_buffer[4096];
 } GameMessage;
 
+struct Journal;
+
 typedef struct
 {
     BattleState state;
@@ -47,15 +85,68 @@ typedef struct
     char current_attacker[32];
     DamageResult local_calc_result;
     DamageResult remote_calc_report;
+
+    unsigned int last_event_seq; // spectators: newest feed event applied
+
+    // Running hash of the battle as both players must see it (host's side
+    // first), folded forward by finalize_turn(); peers compare it on confirm
+    unsigned int turn_number;
+    uint64_t state_digest;
+
+    // Discrepancy resolution: the defender's HP before this turn's hit, and
+    // whether we are waiting on the peer's RESOLUTION_REQUEST
+    int turn_defender_hp;
+    bool awaiting_resolution;
+    unsigned int rng_seed; // from the host's HANDSHAKE_RESPONSE, sent with the turn inputs
+
+    long long turn_started_us; // this turn's ATTACK_ANNOUNCE, for METRIC_TURN_TIME; 0: none
+
+    struct Journal *journal; // NULL: not recorded (see journal.h)
 } BattleContext;
 
+// How often reports disagreed, and how it ended (all battles, all threads)
+typedef struct
+{
+    unsigned long long requested; // mismatches we sent a RESOLUTION_REQUEST for
+    unsigned long long resolved;  // settled by recomputing from the host's inputs
+    unsigned long long corrected; // ...where our own result was the one that changed
+} ResolutionStats;
+
+typedef void (*MessageHandler)(BattleContext *ctx, GameMessage *msg);
+
 // Public interfaces
 void init_battle(BattleContext *ctx, PlayerRole role, const char *pokemon_name);
+void init_battle_state(BattleContext *ctx, PlayerRole role, const char *pokemon_name);
 void execute_move_command(BattleContext *ctx, const char *move_name);
 void process_incoming_message(BattleContext *ctx, GameMessage *msg);
+void handle_spectator_event(BattleContext *ctx, GameMessage *msg);
+// True while the battle can only move on once the opponent acts
+bool battle_awaiting_opponent(const BattleContext *ctx);
+
+// Late-join catch-up: the host sends its view as one BATTLE_SNAPSHOT line,
+// then the spectator applies only feed events newer than event_seq
+void send_battle_snapshot(const BattleContext *battle, unsigned int event_seq);
+bool apply_battle_snapshot(BattleContext *ctx, const char *raw);
+
+// Desync detection: CALCULATION_CONFIRM carries turn_number and the 8-byte
+// state_digest; on a mismatch the host sends its snapshot and the joiner
+// adopts it
+void handle_calculation_confirm(BattleContext *ctx, GameMessage *msg);
+void format_state_digest(uint64_t digest, char out[17]);
+
+// Discrepancy resolution: when a CALCULATION_REPORT disagrees with the local
+// result, both peers send their turn inputs in a RESOLUTION_REQUEST, recompute
+// from the host's and finalize the turn on the agreed result
+void handle_resolution_request(BattleContext *ctx, GameMessage *msg);
+ResolutionStats get_resolution_stats(void);
+
+// Message type table
+MessageType message_type_from_string(const char *name);
+const char *message_type_name(MessageType type);
+// Replaces the handler for a type; NULL unregisters it
+void register_message_handler(MessageType type, MessageHandler handler);
 
 // Network simulation helpers
 void send_packet(const char *format, ...);
-void set_shared_rng_seed(unsigned int seed);
 
 #endif
\ No newline at end of file
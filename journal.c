@@ -0,0 +1,719 @@
+#include "journal.h"
+#include "log.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #include <io.h>
+    #include <process.h>
+    #define make_dir(p) _mkdir(p)
+    #define open_file(p) _open(p, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, 0644)
+    #define write_fd _write
+    #define sync_fd _commit
+    #define close_fd _close
+    #define get_pid _getpid
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #define make_dir(p) mkdir(p, 0755)
+    #define open_file(p) open(p, O_WRONLY | O_CREAT | O_EXCL, 0644)
+    #define write_fd write
+    #define sync_fd fsync
+    #define close_fd close
+    #define get_pid getpid
+#endif
+
+extern long long current_time_ms();
+extern void parse_kv(char *buffer, GameMessage *msg);
+
+// A written buffer on its way back to its journal; the link lives in the
+// buffer's first bytes
+typedef struct SpareBuffer {
+    struct SpareBuffer *next;
+} SpareBuffer;
+
+struct Journal {
+    // Owner side: only the thread driving the battle touches these
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    int buffers;        // allocated so far, recycled from then on
+    int max_buffers;    // 0: no limit
+    SpareBuffer *spare; // taken back from returned, ready to fill
+    bool submitted;     // the writer has seen this journal
+    bool cut_short;     // ran out of buffers: nothing more is recorded
+    long long opened_ms;
+    JournalState last;
+    bool has_last;
+    char path[160];
+
+    // Shared: the writer pushes written buffers, the owner takes them all
+    SpareBuffer *returned;
+    int failed;         // set by the writer: the file couldn't be created
+
+    // Writer side; -1 until the writer creates the file
+    int fd;
+    bool in_batch;      // already queued for this round's fsync
+    Journal *next_sync;
+};
+
+// A filled buffer on its way to disk; close marks the journal's last one.
+// The chunk sits just past the buffer's cap bytes, so handing over allocates
+// nothing; only a close with no buffer in hand gets a chunk of its own.
+typedef struct JournalChunk {
+    Journal *journal;
+    unsigned char *data;
+    size_t len;
+    bool close;
+    struct JournalChunk *next;
+} JournalChunk;
+
+// Room for the records, rounded up so the chunk after them is aligned
+static size_t records_bytes(const Journal *j) {
+    return (j->cap + 15) & ~(size_t)15;
+}
+
+static unsigned char *new_buffer(const Journal *j) {
+    return malloc(records_bytes(j) + sizeof(JournalChunk));
+}
+
+// --- Encoding ---
+static void put_u16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+// --- Writer ---
+// One thread serves every journal in the process. Each round it creates the
+// files it hasn't seen yet, writes all queued chunks, fsyncs each file
+// touched once, then sleeps JOURNAL_SYNC_MS so later chunks share the next
+// fsync. Written buffers go back to their journal for reuse.
+static void write_all(int fd, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        long n = (long)write_fd(fd, data, (unsigned int)len);
+        if (n <= 0) return; // disk full or gone: the journal is best effort
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+// The owner learns of a failure through j->failed and stops recording; only
+// the first failure is logged, or a full fd table would flood the log
+static void open_journal_file(Journal *j) {
+    static int warned = 0;
+    make_dir(JOURNAL_DIR);
+    j->fd = open_file(j->path);
+    if (j->fd >= 0) return;
+    __atomic_store_n(&j->failed, 1, __ATOMIC_RELEASE);
+    if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+        LOG_WARN("[JOURNAL] Cannot create %s: %s; battles that can't open a journal go unrecorded\n", j->path,
+                 strerror(errno));
+}
+
+static void give_back(Journal *j, unsigned char *data) {
+    SpareBuffer *b = (SpareBuffer *)data;
+    b->next = __atomic_load_n(&j->returned, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&j->returned, &b->next, b, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+}
+
+static void write_batch(JournalChunk *list) {
+    Journal *synced = NULL;
+    for (JournalChunk *c = list; c; c = c->next) {
+        if (c->journal->fd < 0 && !c->journal->failed) open_journal_file(c->journal);
+        if (c->journal->fd < 0) continue;
+        if (c->len > 0) write_all(c->journal->fd, c->data, c->len);
+        if (!c->journal->in_batch) {
+            c->journal->in_batch = true;
+            c->journal->next_sync = synced;
+            synced = c->journal;
+        }
+    }
+    for (Journal *j = synced; j; j = j->next_sync) {
+        sync_fd(j->fd);
+        j->in_batch = false;
+    }
+    while (list) {
+        JournalChunk *c = list;
+        list = c->next;
+        Journal *j = c->journal;
+        if (c->close) {
+            if (j->fd >= 0) close_fd(j->fd);
+            while (j->returned) {
+                SpareBuffer *b = j->returned;
+                j->returned = b->next;
+                free(b);
+            }
+            free(j);
+            if (c->data) free(c->data); // the chunk goes with it
+            else free(c);
+        } else {
+            give_back(j, c->data);
+        }
+    }
+}
+
+#ifdef _WIN32
+// No writer thread here: chunks are written as they are handed over
+static void submit_chunk(JournalChunk *c) {
+    c->next = NULL;
+    write_batch(c);
+}
+
+void journal_shutdown(void) {}
+#else
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t writer_idle = PTHREAD_COND_INITIALIZER;
+static JournalChunk *queue_head = NULL, *queue_tail = NULL;
+static bool writer_started = false;
+static bool writer_busy = false;
+
+static void *writer_loop(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&writer_lock);
+    for (;;) {
+        while (!queue_head) {
+            writer_busy = false;
+            pthread_cond_broadcast(&writer_idle);
+            pthread_cond_wait(&writer_wake, &writer_lock);
+        }
+        writer_busy = true;
+        JournalChunk *list = queue_head;
+        queue_head = queue_tail = NULL;
+        pthread_mutex_unlock(&writer_lock);
+
+        write_batch(list);
+        usleep(JOURNAL_SYNC_MS * 1000);
+
+        pthread_mutex_lock(&writer_lock);
+    }
+    return NULL;
+}
+
+static void submit_chunk(JournalChunk *c) {
+    c->next = NULL;
+    pthread_mutex_lock(&writer_lock);
+    if (!writer_started) {
+        pthread_t thread;
+        writer_started = pthread_create(&thread, NULL, writer_loop, NULL) == 0;
+        if (writer_started) pthread_detach(thread);
+    }
+    if (!writer_started) {
+        // No thread to hand it to: write it ourselves
+        pthread_mutex_unlock(&writer_lock);
+        write_batch(c);
+        return;
+    }
+    if (queue_tail) queue_tail->next = c;
+    else queue_head = c;
+    queue_tail = c;
+    pthread_cond_signal(&writer_wake);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+void journal_shutdown(void) {
+    pthread_mutex_lock(&writer_lock);
+    while (writer_started && (queue_head || writer_busy))
+        pthread_cond_wait(&writer_idle, &writer_lock);
+    pthread_mutex_unlock(&writer_lock);
+}
+#endif
+
+static void free_spares(Journal *j) {
+    while (j->spare) {
+        SpareBuffer *b = j->spare;
+        j->spare = b->next;
+        free(b);
+    }
+}
+
+// A buffer for the next records: one the writer gave back, or (if grow and
+// the journal is under max_buffers) a new one
+static unsigned char *take_buffer(Journal *j, bool grow) {
+    if (!j->spare) j->spare = __atomic_exchange_n(&j->returned, NULL, __ATOMIC_ACQUIRE);
+    if (j->spare) {
+        SpareBuffer *b = j->spare;
+        j->spare = b->next;
+        return (unsigned char *)b;
+    }
+    if (!grow || (j->max_buffers > 0 && j->buffers >= j->max_buffers)) return NULL;
+    unsigned char *b = new_buffer(j);
+    if (b) j->buffers++;
+    return b;
+}
+
+static void hand_over(Journal *j, bool close) {
+    if (j->len == 0 && !close) return;
+    if (!j->submitted && close) {
+        // Nothing worth a file: a handshake that never got to a turn's end
+        bool played = j->has_last && (j->last.turn_number > 0 || j->last.state == STATE_GAME_OVER);
+        if (!played) {
+            free(j->buf);
+            free_spares(j);
+            free(j);
+            return;
+        }
+    }
+    JournalChunk *c = j->buf ? (JournalChunk *)(j->buf + records_bytes(j)) : malloc(sizeof(JournalChunk));
+    if (!c) return;
+    if (close) free_spares(j); // the writer frees j after this chunk
+    c->journal = j;
+    c->data = j->buf;
+    c->len = j->len;
+    c->close = close;
+    j->buf = NULL;
+    j->len = 0;
+    j->submitted = true;
+    submit_chunk(c);
+}
+
+// Turn ends hand the buffer over only when the next one is free to have: a
+// spare, or the second buffer. Otherwise the records wait for the next turn
+// end or a full buffer, so a fast battle doesn't allocate a buffer a turn.
+static void hand_over_at_turn_end(Journal *j) {
+    if (j->len == 0 || __atomic_load_n(&j->failed, __ATOMIC_ACQUIRE)) return;
+    unsigned char *next = take_buffer(j, j->buffers < 2);
+    if (!next) return;
+    hand_over(j, false);
+    j->buf = next;
+}
+
+// --- Recording ---
+Journal *journal_create(unsigned int session_id, size_t buffer_bytes, int max_buffers) {
+    static unsigned int counter = 0;
+    Journal *j = calloc(1, sizeof(Journal));
+    if (!j) return NULL;
+    snprintf(j->path, sizeof(j->path), "%s/%lld-%d-%u-%u.pkj", JOURNAL_DIR, (long long)time(NULL), (int)get_pid(),
+             session_id, __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+    j->fd = -1;
+    j->cap = buffer_bytes > JOURNAL_HEADER_BYTES ? buffer_bytes : JOURNAL_BUFFER_BYTES;
+    j->max_buffers = max_buffers > 0 && max_buffers < 2 ? 2 : max_buffers;
+    j->opened_ms = current_time_ms();
+    j->buf = new_buffer(j);
+    if (!j->buf) {
+        free(j);
+        return NULL;
+    }
+    j->buffers = 1;
+    memcpy(j->buf, JOURNAL_MAGIC, 4);
+    put_u32(j->buf + 4, session_id);
+    put_u64(j->buf + 8, (uint64_t)time(NULL));
+    j->len = JOURNAL_HEADER_BYTES;
+    return j;
+}
+
+static void append(Journal *j, JournalKind kind, MessageType type, const void *payload, size_t len) {
+    size_t need = JOURNAL_RECORD_HEADER_BYTES + len;
+    if (need > j->cap || j->cut_short || __atomic_load_n(&j->failed, __ATOMIC_ACQUIRE)) return;
+    if (j->buf && j->len + need > j->cap) hand_over(j, false);
+    if (!j->buf) j->buf = take_buffer(j, true);
+    if (!j->buf) {
+        // Every buffer is still with the writer. Stop here rather than leave
+        // a gap: the file ends early, which the verifier reports as truncated.
+        static int warned = 0;
+        j->cut_short = true;
+        if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+            LOG_WARN("[JOURNAL] Writer behind, %s cut short after %d buffers\n", j->path, j->buffers);
+        return;
+    }
+    unsigned char *p = j->buf + j->len;
+    put_u32(p, (uint32_t)len);
+    p[4] = (unsigned char)kind;
+    p[5] = (unsigned char)type;
+    put_u16(p + 6, 0);
+    put_u32(p + 8, (uint32_t)(current_time_ms() - j->opened_ms));
+    memcpy(p + JOURNAL_RECORD_HEADER_BYTES, payload, len);
+    j->len += need;
+}
+
+void journal_record_begin(Journal *j, PlayerRole role, const char *pokemon) {
+    if (!j) return;
+    unsigned char payload[1 + 32];
+    size_t n = strlen(pokemon);
+    if (n > 31) n = 31;
+    payload[0] = (unsigned char)role;
+    memcpy(payload + 1, pokemon, n);
+    append(j, JOURNAL_BEGIN, MSG_UNKNOWN, payload, 1 + n);
+    j->has_last = false;
+}
+
+void journal_record_message(Journal *j, JournalKind kind, MessageType type, const char *raw, size_t len) {
+    if (!j) return;
+    append(j, kind, type, raw, len);
+}
+
+void journal_record_move(Journal *j, const char *move) {
+    if (!j) return;
+    append(j, JOURNAL_MOVE, MSG_UNKNOWN, move, strlen(move));
+}
+
+void journal_capture_state(const BattleContext *ctx, JournalState *out) {
+    memset(out, 0, sizeof(*out));
+    out->state = ctx->state;
+    out->is_my_turn = ctx->is_my_turn;
+    out->turn_number = ctx->turn_number;
+    out->my_hp = ctx->my_hp;
+    out->opponent_hp = ctx->opponent_hp;
+    out->state_digest = ctx->state_digest;
+}
+
+static bool same_state(const JournalState *a, const JournalState *b) {
+    return a->state == b->state && a->is_my_turn == b->is_my_turn && a->turn_number == b->turn_number &&
+           a->my_hp == b->my_hp && a->opponent_hp == b->opponent_hp && a->state_digest == b->state_digest;
+}
+
+void journal_record_state(Journal *j, const BattleContext *ctx) {
+    if (!j) return;
+    JournalState s;
+    journal_capture_state(ctx, &s);
+    if (j->has_last && same_state(&s, &j->last)) return;
+    bool turn_ended = j->has_last && s.turn_number != j->last.turn_number;
+    j->last = s;
+    j->has_last = true;
+
+    unsigned char p[JOURNAL_STATE_BYTES];
+    p[0] = (unsigned char)s.state;
+    p[1] = s.is_my_turn ? 1 : 0;
+    put_u16(p + 2, 0);
+    put_u32(p + 4, s.turn_number);
+    put_u32(p + 8, (uint32_t)s.my_hp);
+    put_u32(p + 12, (uint32_t)s.opponent_hp);
+    put_u64(p + 16, s.state_digest);
+    append(j, JOURNAL_STATE, MSG_UNKNOWN, p, sizeof(p));
+
+    // Turn boundaries are a natural point to let the writer have what we have
+    if (turn_ended || s.state == STATE_GAME_OVER) hand_over_at_turn_end(j);
+}
+
+size_t journal_memory_bytes(const Journal *j) {
+    if (!j || j->max_buffers <= 0) return 0;
+    return sizeof(Journal) + (size_t)j->max_buffers * (records_bytes(j) + sizeof(JournalChunk));
+}
+
+void journal_flush(Journal *j) {
+    if (j) hand_over(j, false);
+}
+
+void journal_close(Journal *j) {
+    if (j) hand_over(j, true);
+}
+
+// --- Reading ---
+// Maps a whole file read-only, or reads it into memory where mmap isn't there
+static bool map_file(const char *path, size_t min_size, const unsigned char **base, size_t *size, bool *mapped) {
+    *base = NULL;
+    *mapped = false;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    if (len < (long)min_size || len <= 0) {
+        fclose(fp);
+        return false;
+    }
+    *size = (size_t)len;
+#ifndef _WIN32
+    void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map != MAP_FAILED) {
+        *base = map;
+        *mapped = true;
+    }
+#endif
+    if (!*base) {
+        unsigned char *buf = malloc(*size);
+        rewind(fp);
+        if (!buf || fread(buf, 1, *size, fp) != *size) {
+            free(buf);
+            fclose(fp);
+            return false;
+        }
+        *base = buf;
+    }
+    fclose(fp);
+    return true;
+}
+
+static void unmap_file(const unsigned char *base, size_t size, bool mapped) {
+    if (!base) return;
+#ifndef _WIN32
+    if (mapped) munmap((void *)base, size);
+    else
+#endif
+        free((void *)base);
+}
+
+bool journal_reader_open(JournalReader *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    if (!map_file(path, JOURNAL_HEADER_BYTES, &r->base, &r->size, &r->mapped)) return false;
+    if (memcmp(r->base, JOURNAL_MAGIC, 4) != 0) {
+        journal_reader_close(r);
+        return false;
+    }
+    r->session_id = get_u32(r->base + 4);
+    r->opened = get_u64(r->base + 8);
+    r->pos = JOURNAL_HEADER_BYTES;
+    return true;
+}
+
+bool journal_reader_next(JournalReader *r, JournalRecord *rec) {
+    if (r->pos + JOURNAL_RECORD_HEADER_BYTES > r->size) return false;
+    const unsigned char *p = r->base + r->pos;
+    uint32_t len = get_u32(p);
+    if (len > r->size - r->pos - JOURNAL_RECORD_HEADER_BYTES) return false;
+    rec->offset = r->pos;
+    rec->len = len;
+    rec->kind = (JournalKind)p[4];
+    rec->type = (MessageType)p[5];
+    rec->time_ms = get_u32(p + 8);
+    rec->data = (const char *)p + JOURNAL_RECORD_HEADER_BYTES;
+    r->pos += JOURNAL_RECORD_HEADER_BYTES + len;
+    return true;
+}
+
+void journal_reader_close(JournalReader *r) {
+    unmap_file(r->base, r->size, r->mapped);
+    r->base = NULL;
+}
+
+bool journal_decode_state(const JournalRecord *rec, JournalState *out) {
+    if (rec->kind != JOURNAL_STATE || rec->len != JOURNAL_STATE_BYTES) return false;
+    const unsigned char *p = (const unsigned char *)rec->data;
+    memset(out, 0, sizeof(*out));
+    out->state = (BattleState)p[0];
+    out->is_my_turn = p[1] != 0;
+    out->turn_number = get_u32(p + 4);
+    out->my_hp = (int)get_u32(p + 8);
+    out->opponent_hp = (int)get_u32(p + 12);
+    out->state_digest = get_u64(p + 16);
+    return true;
+}
+
+// --- Replay ---
+// Applies one record to ctx the way the live battle did
+static void apply_record(BattleContext *ctx, const JournalRecord *rec, JournalReplayResult *out, bool verbose) {
+    GameMessage msg;
+    char buf[4096];
+    size_t n = rec->len < sizeof(buf) - 1 ? rec->len : sizeof(buf) - 1;
+    out->records++;
+    switch (rec->kind) {
+    case JOURNAL_BEGIN: {
+        char name[32];
+        size_t nlen = n > 0 ? n - 1 : 0;
+        if (nlen > 31) nlen = 31;
+        memcpy(name, rec->data + 1, nlen);
+        name[nlen] = '\0';
+        init_battle_state(ctx, (PlayerRole)(unsigned char)rec->data[0], name);
+        break;
+    }
+    case JOURNAL_IN:
+        memcpy(buf, rec->data, n);
+        buf[n] = '\0';
+        memset(&msg, 0, sizeof(msg));
+        parse_kv(buf, &msg);
+        process_incoming_message(ctx, &msg);
+        out->messages++;
+        break;
+    case JOURNAL_MOVE:
+        memcpy(buf, rec->data, n);
+        buf[n] = '\0';
+        execute_move_command(ctx, buf);
+        out->moves++;
+        break;
+    case JOURNAL_STATE: {
+        JournalState recorded, replayed;
+        if (!journal_decode_state(rec, &recorded)) break;
+        journal_capture_state(ctx, &replayed);
+        out->states++;
+        if (!same_state(&recorded, &replayed)) {
+            out->state_mismatches++;
+            if (verbose)
+                printf("[REPLAY] Record at %zu: recorded turn %u HP %d/%d, replayed turn %u HP %d/%d\n",
+                       rec->offset, recorded.turn_number, recorded.my_hp, recorded.opponent_hp,
+                       replayed.turn_number, replayed.my_hp, replayed.opponent_hp);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Turns finished by a record: turn_number only grows within a battle, and
+// a BEGIN restarts it without finishing anything
+static unsigned long turns_finished(const BattleContext *ctx, const JournalRecord *rec, unsigned int before) {
+    if (rec->kind == JOURNAL_BEGIN || ctx->turn_number <= before) return 0;
+    return ctx->turn_number - before;
+}
+
+bool journal_replay(const char *path, JournalReplayResult *out, bool verbose) {
+    JournalReader r;
+    memset(out, 0, sizeof(*out));
+    if (!journal_reader_open(&r, path)) return false;
+
+    JournalRecord rec;
+    while (journal_reader_next(&r, &rec))
+        apply_record(&out->final, &rec, out, verbose);
+    journal_reader_close(&r);
+    return true;
+}
+
+// --- Seeking ---
+static void index_path(const char *journal_path, char *out, size_t cap) {
+    snprintf(out, cap, "%s%s", journal_path, JOURNAL_INDEX_SUFFIX);
+}
+
+static uint32_t index_entry_bytes(void) {
+    return (uint32_t)((JOURNAL_INDEX_ENTRY_HEADER_BYTES + sizeof(BattleContext) + 7) & ~(size_t)7);
+}
+
+long journal_index_build(const char *journal_path) {
+    JournalReader r;
+    if (!journal_reader_open(&r, journal_path)) return -1;
+    char path[512], tmp[520];
+    index_path(journal_path, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        journal_reader_close(&r);
+        return -1;
+    }
+
+    uint32_t entry_bytes = index_entry_bytes();
+    unsigned char *entry = calloc(1, entry_bytes);
+    unsigned char header[JOURNAL_INDEX_HEADER_BYTES] = {0};
+    fwrite(header, 1, sizeof(header), fp); // filled in once the count is known
+
+    BattleContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    JournalReplayResult scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    JournalRecord rec;
+    unsigned long turn = 0;
+    long count = 0;
+    while (journal_reader_next(&r, &rec)) {
+        unsigned int before = ctx.turn_number;
+        apply_record(&ctx, &rec, &scratch, false);
+        unsigned long done = turns_finished(&ctx, &rec, before);
+        if (done == 0) continue;
+        unsigned long prev = turn;
+        turn += done;
+        if (turn / JOURNAL_CHECKPOINT_TURNS == prev / JOURNAL_CHECKPOINT_TURNS) continue;
+        // Resume point: the record right after the one that ended the turn
+        put_u64(entry, turn);
+        put_u64(entry + 8, r.pos);
+        memcpy(entry + JOURNAL_INDEX_ENTRY_HEADER_BYTES, &ctx, sizeof(ctx));
+        fwrite(entry, 1, entry_bytes, fp);
+        count++;
+    }
+
+    memcpy(header, JOURNAL_INDEX_MAGIC, 4);
+    put_u32(header + 4, entry_bytes);
+    put_u32(header + 8, (uint32_t)count);
+    put_u32(header + 12, (uint32_t)sizeof(BattleContext));
+    put_u64(header + 16, r.size);
+    put_u64(header + 24, turn);
+    rewind(fp);
+    fwrite(header, 1, sizeof(header), fp);
+    bool ok = fclose(fp) == 0;
+    free(entry);
+    journal_reader_close(&r);
+    remove(path); // rename() won't replace on Windows
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return count;
+}
+
+// An index is only used if it was built by this build, from the journal as it is now
+static bool index_usable(const JournalSeeker *s) {
+    const unsigned char *h = s->index;
+    if (memcmp(h, JOURNAL_INDEX_MAGIC, 4) != 0) return false;
+    if (get_u32(h + 4) != index_entry_bytes() || get_u32(h + 12) != sizeof(BattleContext)) return false;
+    if (get_u64(h + 16) != s->journal.size) return false;
+    uint64_t count = get_u32(h + 8);
+    return JOURNAL_INDEX_HEADER_BYTES + count * index_entry_bytes() <= s->index_size;
+}
+
+bool journal_seeker_open(JournalSeeker *s, const char *journal_path) {
+    memset(s, 0, sizeof(*s));
+    if (!journal_reader_open(&s->journal, journal_path)) return false;
+    char path[512];
+    index_path(journal_path, path, sizeof(path));
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (map_file(path, JOURNAL_INDEX_HEADER_BYTES, &s->index, &s->index_size, &s->index_mapped)) {
+            if (index_usable(s)) {
+                s->count = get_u32(s->index + 8);
+                s->turns = get_u64(s->index + 24);
+                s->entry_bytes = get_u32(s->index + 4);
+                return true;
+            }
+            unmap_file(s->index, s->index_size, s->index_mapped);
+            s->index = NULL;
+        }
+        if (attempt == 0 && journal_index_build(journal_path) < 0) break;
+    }
+    journal_reader_close(&s->journal);
+    return false;
+}
+
+void journal_seeker_close(JournalSeeker *s) {
+    unmap_file(s->index, s->index_size, s->index_mapped);
+    s->index = NULL;
+    journal_reader_close(&s->journal);
+}
+
+bool journal_seek(JournalSeeker *s, unsigned long turn, BattleContext *out) {
+    if (turn == 0 || turn > s->turns) return false;
+
+    // Last checkpoint at or before the turn
+    uint32_t lo = 0, hi = s->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (get_u64(s->index + JOURNAL_INDEX_HEADER_BYTES + (size_t)mid * s->entry_bytes) <= turn) lo = mid + 1;
+        else hi = mid;
+    }
+    unsigned long at = 0;
+    s->journal.pos = JOURNAL_HEADER_BYTES;
+    memset(out, 0, sizeof(*out));
+    if (lo > 0) {
+        const unsigned char *e = s->index + JOURNAL_INDEX_HEADER_BYTES + (size_t)(lo - 1) * s->entry_bytes;
+        at = (unsigned long)get_u64(e);
+        s->journal.pos = (size_t)get_u64(e + 8);
+        memcpy(out, e + JOURNAL_INDEX_ENTRY_HEADER_BYTES, sizeof(*out));
+    }
+
+    // Replay the few records between the checkpoint and the turn
+    JournalReplayResult scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    JournalRecord rec;
+    while (at < turn && journal_reader_next(&s->journal, &rec)) {
+        unsigned int before = out->turn_number;
+        apply_record(out, &rec, &scratch, false);
+        at += turns_finished(out, &rec, before);
+    }
+    return at >= turn;
+}
@@ -0,0 +1,147 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game_logic.h"
+
+// Append-only binary battle log, one file per session under JOURNAL_DIR.
+// Everything is little-endian:
+//   header  "PKJ1" | u32 session_id | u64 opened (unix seconds)
+//   record  u32 payload_len | u8 kind | u8 message_type | u16 reserved |
+//           u32 ms since opened | payload
+// Appends only copy into a per-journal buffer; a background thread creates
+// the file, writes the buffers out, fsyncs every JOURNAL_SYNC_MS and gives
+// the buffers back for reuse, so the turn path never touches the disk.
+
+#define JOURNAL_DIR "journals"
+#define JOURNAL_MAGIC "PKJ1"
+#define JOURNAL_HEADER_BYTES 16
+#define JOURNAL_RECORD_HEADER_BYTES 12
+#define JOURNAL_BUFFER_BYTES (64 * 1024) // default buffer, handed to the writer when full
+#define JOURNAL_SYNC_MS 200              // group commit interval
+
+typedef enum {
+    JOURNAL_BEGIN = 1, // u8 role | my Pokémon: a (re)started battle
+    JOURNAL_IN,        // a received message, as parsed
+    JOURNAL_OUT,       // a message the battle logic sent
+    JOURNAL_MOVE,      // move name: a local execute_move_command()
+    JOURNAL_STATE      // JournalState after the record before it changed it
+} JournalKind;
+
+// The BattleContext fields a transition can change, JOURNAL_STATE_BYTES on disk
+typedef struct {
+    BattleState state;
+    bool is_my_turn;
+    unsigned int turn_number;
+    int my_hp;
+    int opponent_hp;
+    uint64_t state_digest;
+} JournalState;
+#define JOURNAL_STATE_BYTES 24
+
+typedef struct Journal Journal;
+
+// --- Recording ---
+// Starts a journal for one session. buffer_bytes caps each append buffer (and
+// the largest record); 0 means JOURNAL_BUFFER_BYTES. max_buffers caps how
+// many it may hold, with the writer's (at least 2; 0 means no cap): a journal
+// whose buffers are all still with the writer when one fills is cut short.
+// The file is only created after the first hand-over, and a journal closed
+// before any turn ended leaves none behind. NULL when out of memory.
+Journal *journal_create(unsigned int session_id, size_t buffer_bytes, int max_buffers);
+// All recorders accept NULL and do nothing
+void journal_record_begin(Journal *j, PlayerRole role, const char *pokemon);
+void journal_record_message(Journal *j, JournalKind kind, MessageType type, const char *raw, size_t len);
+void journal_record_move(Journal *j, const char *move);
+// Skipped when nothing changed since the last state record
+void journal_record_state(Journal *j, const BattleContext *ctx);
+// The most memory j can hold: its buffers at max_buffers, with the writer's
+// counted; 0 for NULL or an uncapped journal
+size_t journal_memory_bytes(const Journal *j);
+// Hands buffered records to the writer (done automatically at turn ends)
+void journal_flush(Journal *j);
+// Flushes and lets the writer close the file; j is gone afterwards
+void journal_close(Journal *j);
+// Waits until everything handed over is on disk (call before exiting)
+void journal_shutdown(void);
+
+// --- Reading ---
+typedef struct {
+    JournalKind kind;
+    MessageType type;
+    uint32_t time_ms;
+    const char *data; // payload inside the mapping, not NUL-terminated
+    uint32_t len;
+    size_t offset;    // of the record header within the file
+} JournalRecord;
+
+typedef struct {
+    const unsigned char *base; // whole file, mmap'ed where possible
+    size_t size;
+    size_t pos;
+    unsigned int session_id;
+    uint64_t opened;
+    bool mapped;
+} JournalReader;
+
+bool journal_reader_open(JournalReader *r, const char *path);
+// False at the end, or at a torn record left by a crash
+bool journal_reader_next(JournalReader *r, JournalRecord *rec);
+void journal_reader_close(JournalReader *r);
+bool journal_decode_state(const JournalRecord *rec, JournalState *out);
+void journal_capture_state(const BattleContext *ctx, JournalState *out);
+
+// --- Replay ---
+typedef struct {
+    unsigned long records;
+    unsigned long messages;      // JOURNAL_IN fed to process_incoming_message()
+    unsigned long moves;
+    unsigned long states;        // JOURNAL_STATE records checked
+    unsigned long state_mismatches;
+    BattleContext final;         // where the replay ended
+} JournalReplayResult;
+
+// Re-runs a journal offline through process_incoming_message() and checks
+// each recorded state against the replayed one. Must run without a network
+// worker; replies the logic sends are dropped.
+bool journal_replay(const char *path, JournalReplayResult *out, bool verbose);
+
+// --- Seeking ---
+// Sidecar index <journal>.idx: a copy of the replayed BattleContext every
+// JOURNAL_CHECKPOINT_TURNS turns, in fixed-size entries so a seek is a
+// binary search plus at most that many turns of replay. Turns are counted
+// from the start of the file, across every battle in it.
+//   header  "PKX1" | u32 entry_bytes | u32 count | u32 sizeof(BattleContext) |
+//           u64 journal bytes indexed | u64 turns in the journal
+//   entry   u64 turn | u64 offset of the next record | BattleContext (native)
+// Checkpoints are in this build's native layout; an index from another
+// build, or from a journal that has grown since, is rebuilt.
+#define JOURNAL_INDEX_SUFFIX ".idx"
+#define JOURNAL_INDEX_MAGIC "PKX1"
+#define JOURNAL_INDEX_HEADER_BYTES 32
+#define JOURNAL_INDEX_ENTRY_HEADER_BYTES 16
+#define JOURNAL_CHECKPOINT_TURNS 16
+
+typedef struct {
+    JournalReader journal;
+    const unsigned char *index; // mmap'ed where possible, like the journal
+    size_t index_size;
+    bool index_mapped;
+    uint32_t entry_bytes;
+    uint32_t count;
+    unsigned long turns;        // finished turns in the journal
+} JournalSeeker;
+
+// Replays a journal and writes its index; checkpoints written, or -1
+long journal_index_build(const char *journal_path);
+// Maps the journal and its index, building the index first if it is
+// missing or stale
+bool journal_seeker_open(JournalSeeker *s, const char *journal_path);
+// The battle right after the journal's turn-th finished turn (from 1);
+// false past the last one
+bool journal_seek(JournalSeeker *s, unsigned long turn, BattleContext *out);
+void journal_seeker_close(JournalSeeker *s);
+
+#endif
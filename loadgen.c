@@ -0,0 +1,409 @@
+#include "loadgen.h"
+#include "network.h"
+#include "game_logic.h"
+#include "damage_calc.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h> // dup
+#define NULL_DEVICE "NUL"
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+typedef struct LoadWorker LoadWorker;
+
+typedef struct
+{
+    LoadWorker *worker;
+    NetSession *session; // current battle, NULL while waiting for a free slot
+    long long turn_us;   // when the open turn began, 0 before the battle is set up
+    long long wait_us;   // when the bot started waiting for a slot, 0 if it isn't
+} LoadBot;
+
+struct LoadWorker
+{
+    int index;
+    NetWorker *net;
+    LoadBot *bots;
+    int bot_count;
+    int waiting; // bots without a session
+
+    // Written by this worker only; the reporter reads them as they go
+    unsigned long long started;
+    unsigned long long finished;
+    unsigned long long stalled;
+    unsigned long long turns;
+    unsigned long long slot_waits;   // bot_start() calls that found the table full
+    unsigned long long slot_wait_us; // time bots spent waiting for a free slot
+
+    // Turn latencies in µs, for the summary
+    unsigned int *latency_us;
+    size_t latency_count, latency_cap;
+};
+
+// What every worker plays, fixed before the threads start
+static struct
+{
+    const char *host_ip;
+    int host_port;
+    const char *pokemon_name;
+    const char *move;
+    long long stop_ms;
+    LoadWorker *workers;
+    int worker_count;
+} plan;
+
+static FILE *out; // stdout proper: the battle logic's own prints go to the null device
+
+extern long long current_time_ms();
+
+static long long now_us(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, t;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (long long)(t.QuadPart * 1000000.0 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+}
+
+static void count(unsigned long long *counter)
+{
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static unsigned long long read_count(unsigned long long *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void add_count(unsigned long long *counter, unsigned long long n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static void record_latency(LoadWorker *w, long long us)
+{
+    if (w->latency_count == w->latency_cap)
+    {
+        size_t cap = w->latency_cap ? w->latency_cap * 2 : 4096;
+        unsigned int *grown = realloc(w->latency_us, cap * sizeof(unsigned int));
+        if (!grown)
+            return;
+        w->latency_us = grown;
+        w->latency_cap = cap;
+    }
+    w->latency_us[w->latency_count++] = (unsigned int)us;
+}
+
+// --- Bots ---
+// The joiner's half of the handshake (what main.c registers)
+static void on_handshake_response(BattleContext *ctx, GameMessage *msg)
+{
+    (void)msg;
+    char setup[64];
+    snprintf(setup, sizeof(setup), "attacker: %s\n", ctx->my_pokemon);
+    net_send_game_message("BATTLE_SETUP", setup);
+}
+
+// Opens a fresh session for the bot's next battle; the old one, if any, is
+// already closing
+static void bot_start(LoadBot *b)
+{
+    b->session = net_connect(plan.host_ip, plan.host_port);
+    b->turn_us = 0;
+    if (!b->session)
+    {
+        // Every slot is taken by sessions still draining; try again later
+        if (!b->wait_us)
+        {
+            b->wait_us = now_us();
+            count(&b->worker->slot_waits);
+        }
+        b->worker->waiting++;
+        return;
+    }
+    if (b->wait_us)
+    {
+        add_count(&b->worker->slot_wait_us, (unsigned long long)(now_us() - b->wait_us));
+        b->wait_us = 0;
+    }
+    net_session_set_user(b->session, b);
+    init_battle_state(net_session_battle(b->session), ROLE_CLIENT, plan.pokemon_name);
+    net_select_session(b->session);
+    net_send_game_message("HANDSHAKE_REQUEST", NULL);
+    net_session_arm_turn_timer(b->session, LOADGEN_STALL_MS);
+    count(&b->worker->started);
+}
+
+static void bot_restart(LoadBot *b)
+{
+    net_session_set_user(b->session, NULL);
+    net_session_close(b->session);
+    bot_start(b);
+}
+
+// The host went quiet for LOADGEN_STALL_MS (gone, or overloaded)
+static void on_stall(NetSession *s, void *arg)
+{
+    (void)arg;
+    LoadBot *b = net_session_user(s);
+    if (!b || b->session != s)
+        return;
+    count(&b->worker->stalled);
+    bot_restart(b);
+}
+
+static void bot_handle(LoadBot *b, GameMessage *msg)
+{
+    LoadWorker *w = b->worker;
+    BattleContext *ctx = net_session_battle(b->session);
+    unsigned int turn = ctx->turn_number;
+
+    process_incoming_message(ctx, msg);
+    net_session_arm_turn_timer(b->session, LOADGEN_STALL_MS);
+
+    // Every turn is sampled, the server's as well as ours: each runs from
+    // the end of the one before (or of the setup) until both sides finished it
+    for (unsigned int t = turn; t < ctx->turn_number; t++)
+        count(&w->turns);
+    if (ctx->turn_number > turn && b->turn_us)
+    {
+        long long now = now_us();
+        record_latency(w, now - b->turn_us);
+        b->turn_us = now;
+    }
+    else if (!b->turn_us && ctx->state == STATE_WAITING_FOR_MOVE)
+    {
+        b->turn_us = now_us();
+    }
+
+    if (ctx->state == STATE_GAME_OVER)
+    {
+        count(&w->finished);
+        bot_restart(b);
+    }
+    else if (ctx->state == STATE_WAITING_FOR_MOVE && ctx->is_my_turn)
+    {
+        execute_move_command(ctx, plan.move);
+    }
+}
+
+// --- Workers ---
+static void *loadgen_worker_loop(void *arg)
+{
+    LoadWorker *w = (LoadWorker *)arg;
+    net_worker_select(w->net);
+    net_set_turn_timeout_handler(on_stall, NULL);
+    for (int i = 0; i < w->bot_count; i++)
+        bot_start(&w->bots[i]);
+
+    GameMessage msg;
+    while (current_time_ms() < plan.stop_ms)
+    {
+        while (net_process_updates(&msg))
+        {
+            NetSession *s = net_active_session();
+            LoadBot *b = net_session_user(s);
+            if (b && b->session == s)
+                bot_handle(b, &msg);
+        }
+        if (w->waiting > 0)
+        {
+            w->waiting = 0;
+            for (int i = 0; i < w->bot_count; i++)
+                if (!w->bots[i].session)
+                    bot_start(&w->bots[i]);
+        }
+        net_wait(w->waiting > 0 ? 10 : 100);
+    }
+    return NULL;
+}
+
+static int compare_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
+
+// Share of the bots' time spent waiting for a free session slot instead of
+// playing; anything above zero means the figures measure loadgen's own table
+static double slot_wait_share(unsigned long long wait_us, double secs)
+{
+    int bots = 0;
+    for (int i = 0; i < plan.worker_count; i++)
+        bots += plan.workers[i].bot_count;
+    return secs > 0 && bots > 0 ? wait_us / (secs * 1e6 * bots) * 100.0 : 0.0;
+}
+
+static void print_progress(double secs, unsigned long long sessions, unsigned long long turns)
+{
+    unsigned long long stalled = 0, wait_us = 0;
+    for (int i = 0; i < plan.worker_count; i++)
+    {
+        stalled += read_count(&plan.workers[i].stalled);
+        wait_us += read_count(&plan.workers[i].slot_wait_us);
+    }
+    fprintf(out,
+            "[LOADGEN] %5.1f s | %8.1f sessions/s | %9.1f turns/s | %llu battles, %llu turns, %llu stalled | slot wait %.1f%%\n",
+            secs, sessions / (secs > 0 ? secs : 1), turns / (secs > 0 ? secs : 1), sessions, turns, stalled,
+            slot_wait_share(wait_us, secs));
+    fflush(out);
+}
+
+static void print_summary(double secs)
+{
+    unsigned long long started = 0, finished = 0, stalled = 0, turns = 0, waits = 0, wait_us = 0;
+    size_t samples = 0;
+    for (int i = 0; i < plan.worker_count; i++)
+    {
+        LoadWorker *w = &plan.workers[i];
+        started += w->started;
+        finished += w->finished;
+        stalled += w->stalled;
+        turns += w->turns;
+        waits += w->slot_waits;
+        wait_us += w->slot_wait_us;
+        samples += w->latency_count;
+    }
+    fprintf(out, "[LOADGEN] %llu battles finished (%llu started, %llu stalled) in %.1f s: %.1f sessions/s, %.1f turns/s\n",
+            finished, started, stalled, secs, finished / secs, turns / secs);
+    fprintf(out, "[LOADGEN] waited for a free session slot %llu times, %.1f ms in all (%.1f%% of bot time)\n", waits,
+            wait_us / 1000.0, slot_wait_share(wait_us, secs));
+
+    unsigned int *all = samples ? malloc(samples * sizeof(unsigned int)) : NULL;
+    if (!all)
+        return;
+    size_t n = 0;
+    for (int i = 0; i < plan.worker_count; i++)
+    {
+        memcpy(all + n, plan.workers[i].latency_us, plan.workers[i].latency_count * sizeof(unsigned int));
+        n += plan.workers[i].latency_count;
+    }
+    qsort(all, n, sizeof(unsigned int), compare_uint);
+    fprintf(out, "[LOADGEN] turn latency over %zu turns: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n", n,
+            all[n / 2] / 1000.0, all[n * 90 / 100] / 1000.0, all[n * 99 / 100] / 1000.0, all[n - 1] / 1000.0);
+    free(all);
+}
+
+int run_loadgen(const char *host_ip, int host_port, int clients, const char *pokemon_name, const char *move,
+                int duration_s, int threads)
+{
+#ifdef _WIN32
+    threads = 1;
+#endif
+    if (clients <= 0)
+        clients = 1;
+    if (threads <= 0)
+        threads = 1;
+    if (threads > LOADGEN_MAX_THREADS)
+        threads = LOADGEN_MAX_THREADS;
+    if (threads > clients)
+        threads = clients;
+    if (duration_s <= 0)
+        duration_s = LOADGEN_DEFAULT_SECONDS;
+
+    load_all_pokemon_and_moves("pokemon.csv");
+    const PokemonData *p = pokemon_name && *pokemon_name ? get_pokemon(pokemon_name) : NULL;
+    if (!p)
+    {
+        if (pokemon_name && *pokemon_name)
+            printf("[LOADGEN] Unknown Pokémon %s, using %s\n", pokemon_name, POKEMON_DB[0].name);
+        p = &POKEMON_DB[0];
+    }
+    if (!move || !*move)
+        move = p->ability_count > 0 ? p->abilities[0] : "Tackle";
+
+    plan.host_ip = host_ip;
+    plan.host_port = host_port;
+    plan.pokemon_name = p->name;
+    plan.move = move;
+    plan.worker_count = threads;
+    plan.workers = calloc((size_t)threads, sizeof(LoadWorker));
+    LoadBot *bots = calloc((size_t)clients, sizeof(LoadBot));
+    if (!plan.workers || !bots)
+        return 1;
+
+    // Each worker gets an ephemeral socket and an even share of the bots; a
+    // finished battle's session lingers until the server's delayed ACK for
+    // its last frames (ACK_DELAY_MS), and a bot can finish several battles in
+    // that time, so there is room for LOADGEN_SLOTS_PER_BOT each and a spare
+    // pool for the few bots that finish fastest (a slot is one pointer until
+    // a session fills it). An SO_REUSEPORT server hashes each socket, not
+    // each bot, to one of its workers, so every bot of a thread lands on the
+    // same server worker; use at least as many threads as the server has
+    // workers. A NetWorker per bot would spread them, but costs its send and
+    // receive batches (over 256 KB) for every bot.
+    for (int i = 0, first = 0; i < threads; i++)
+    {
+        LoadWorker *w = &plan.workers[i];
+        int share = clients / threads + (i < clients % threads ? 1 : 0);
+        w->index = i;
+        w->bots = bots + first;
+        w->bot_count = share;
+        for (int j = 0; j < share; j++)
+            w->bots[j].worker = w;
+        first += share;
+        w->net = net_worker_create(0, share * LOADGEN_SLOTS_PER_BOT + LOADGEN_SPARE_SLOTS, false, false);
+        if (!w->net)
+        {
+            printf("[LOADGEN] Could not open worker %d\n", i);
+            return 1;
+        }
+    }
+    register_message_handler(MSG_HANDSHAKE_RESPONSE, on_handshake_response);
+    log_set_level(LOG_LEVEL_ERROR); // the bots' battle logs would only be thrown away
+
+    printf("[LOADGEN] %d bots on %d thread(s) against %s:%d as %s (%s) for %d s\n", clients, threads, host_ip,
+           host_port, plan.pokemon_name, plan.move, duration_s);
+    printf("[LOADGEN] One socket per thread: a server with more workers than that leaves some idle\n");
+    fflush(stdout);
+    out = fdopen(dup(fileno(stdout)), "w");
+    if (!out || !freopen(NULL_DEVICE, "w", stdout))
+        return 1;
+
+    long long start = current_time_ms();
+    plan.stop_ms = start + duration_s * 1000LL;
+#ifdef _WIN32
+    loadgen_worker_loop(&plan.workers[0]);
+#else
+    pthread_t tids[LOADGEN_MAX_THREADS];
+    for (int i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, loadgen_worker_loop, &plan.workers[i]);
+    while (current_time_ms() < plan.stop_ms)
+    {
+        usleep(LOADGEN_REPORT_MS * 1000);
+        unsigned long long sessions = 0, turns = 0;
+        for (int i = 0; i < threads; i++)
+        {
+            sessions += read_count(&plan.workers[i].finished);
+            turns += read_count(&plan.workers[i].turns);
+        }
+        print_progress((current_time_ms() - start) / 1000.0, sessions, turns);
+    }
+    for (int i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+#endif
+    print_summary((current_time_ms() - start) / 1000.0);
+
+    for (int i = 0; i < threads; i++)
+    {
+        net_worker_destroy(plan.workers[i].net);
+        free(plan.workers[i].latency_us);
+    }
+    free(plan.workers);
+    free(bots);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#define LOADGEN_MAX_THREADS 64
+#define LOADGEN_DEFAULT_SECONDS 10
+#define LOADGEN_REPORT_MS 1000
+#define LOADGEN_STALL_MS 10000 // a bot that hears nothing this long gives its battle up
+#define LOADGEN_SLOTS_PER_BOT 4 // session table room: the current battle plus finished ones draining
+#define LOADGEN_SPARE_SLOTS 256 // shared by a thread's bots on top of that
+
+// Headless joiner fleet for load testing a server. The bots are spread over
+// threads worker threads, one socket each, and every bot is its own session
+// on that socket; an SO_REUSEPORT server puts all of a socket's sessions on
+// one worker, so threads should be at least the server's worker count. Each
+// bot plays battle after battle against host_ip:host_port: HANDSHAKE_REQUEST,
+// BATTLE_SETUP, then an ATTACK_ANNOUNCE with move whenever the turn is its
+// own. Prints sessions/s and turns/s every second, and a summary with turn
+// latency percentiles after duration_s. Every turn is sampled, whoever moves:
+// it runs from the end of the previous turn (or of the setup) until the bot
+// has finished it. Time bots spend waiting for a free slot in their own
+// session table is reported on its own, since it limits loadgen, not the server.
+// pokemon_name/move may be NULL (first Pokémon, its first ability).
+int run_loadgen(const char *host_ip, int host_port, int clients, const char *pokemon_name, const char *move,
+                int duration_s, int threads);
+
+#endif
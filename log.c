@@ -0,0 +1,159 @@
+#include "log.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+#if defined(_MSC_VER)
+    #define LOG_THREAD_LOCAL __declspec(thread)
+#else
+    #define LOG_THREAD_LOCAL __thread
+#endif
+
+int log_level = LOG_LEVEL_DEBUG;
+
+void log_set_level(int level) { log_level = level; }
+
+#ifdef _WIN32
+// No writer thread here: every line goes straight out
+void log_write(int level, const char *fmt, ...) {
+    (void)level;
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+void log_start_async(void) {}
+void log_flush(void) { fflush(stdout); }
+#else
+
+typedef struct {
+    int len;
+    char text[LOG_LINE_MAX];
+} LogLine;
+
+// One producer thread, one consumer (the writer): head is only advanced by
+// the owner, tail only by the writer, each published with release
+typedef struct LogRing {
+    LogLine *lines;
+    unsigned int head;
+    unsigned int tail;
+    unsigned long long dropped;
+    unsigned long long dropped_reported; // writer side
+    struct LogRing *next;
+} LogRing;
+
+static LogRing *rings;   // every thread's ring, pushed once and never removed
+static bool async_on;
+static LOG_THREAD_LOCAL LogRing *my_ring;
+static LOG_THREAD_LOCAL bool ring_failed;
+
+static LogRing *ring_for_thread(void) {
+    if (my_ring || ring_failed) return my_ring;
+    LogRing *r = calloc(1, sizeof(LogRing));
+    if (r) r->lines = malloc(LOG_RING_SLOTS * sizeof(LogLine));
+    if (!r || !r->lines) {
+        free(r);
+        ring_failed = true;
+        return NULL;
+    }
+    r->next = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        ;
+    return my_ring = r;
+}
+
+void log_write(int level, const char *fmt, ...) {
+    (void)level;
+    va_list ap;
+    va_start(ap, fmt);
+    LogRing *r = __atomic_load_n(&async_on, __ATOMIC_ACQUIRE) ? ring_for_thread() : NULL;
+    if (!r) {
+        vprintf(fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    unsigned int head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SLOTS) {
+        // The writer is behind; losing a line beats stalling the turn
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        va_end(ap);
+        return;
+    }
+    LogLine *line = &r->lines[head % LOG_RING_SLOTS];
+    int len = vsnprintf(line->text, LOG_LINE_MAX, fmt, ap);
+    va_end(ap);
+    if (len < 0) return;
+    if (len >= LOG_LINE_MAX) {
+        len = LOG_LINE_MAX - 1;
+        line->text[len - 1] = '\n';
+    }
+    line->len = len;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// --- Writer ---
+static bool drain(void) {
+    bool wrote = false;
+    for (LogRing *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        unsigned int tail = r->tail;
+        for (; tail != head; tail++) {
+            const LogLine *line = &r->lines[tail % LOG_RING_SLOTS];
+            fwrite(line->text, 1, (size_t)line->len, stdout);
+        }
+        if (tail != r->tail) {
+            __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+            wrote = true;
+        }
+        unsigned long long dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        if (dropped != r->dropped_reported) {
+            printf("[LOG] %llu lines dropped (writer behind)\n", dropped - r->dropped_reported);
+            r->dropped_reported = dropped;
+            wrote = true;
+        }
+    }
+    if (wrote) fflush(stdout);
+    return wrote;
+}
+
+static void *writer_loop(void *arg) {
+    (void)arg;
+    for (;;)
+        if (!drain()) usleep(LOG_DRAIN_MS * 1000);
+    return NULL;
+}
+
+static void flush_at_exit(void) {
+    log_flush();
+}
+
+void log_start_async(void) {
+    if (__atomic_load_n(&async_on, __ATOMIC_ACQUIRE)) return;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_loop, NULL) != 0) return;
+    pthread_detach(thread);
+    fflush(stdout);
+    atexit(flush_at_exit);
+    __atomic_store_n(&async_on, true, __ATOMIC_RELEASE);
+}
+
+void log_flush(void) {
+    if (__atomic_load_n(&async_on, __ATOMIC_ACQUIRE)) {
+        // Wait for the writer to catch up with what is in the rings now
+        for (LogRing *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+            unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+            while ((int)(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) > 0) usleep(1000);
+        }
+    }
+    fflush(stdout);
+}
+#endif
@@ -0,0 +1,56 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Leveled logging for the turn path. By default a line is written to stdout
+// at once, like printf. After log_start_async() each thread formats into a
+// ring of its own and a background thread writes the rings out in batches,
+// so a slow stdout (a file, a pipe) never blocks a worker; a full ring drops
+// the line and counts it. Levels below LOG_COMPILE_LEVEL are compiled out,
+// and log_set_level() raises the floor at run time.
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+// -DLOG_COMPILE_LEVEL=0 keeps the per-frame DEBUG lines
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SLOTS 2048 // lines per thread
+#define LOG_LINE_MAX 512    // longer lines are cut
+#define LOG_DRAIN_MS 5      // writer's nap when every ring is empty
+
+extern int log_level;
+
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_set_level(int level);
+// Hands writing to the background thread (POSIX; elsewhere it stays direct)
+void log_start_async(void);
+// Returns once everything logged so far is written
+void log_flush(void);
+
+#define LOG_AT(level, ...)                                                                                   \
+    do {                                                                                                     \
+        if ((level) >= log_level) log_write((level), __VA_ARGS__);                                           \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif
@@ -8,6 +8,15 @@
 #include "game_logic.h"
 #include "damage_calc.h"
 #include "chat.h"
+#include "server.h"
+#include "journal.h"
+#include "verify.h"
+#include "proxy.h"
+#include "loadgen.h"
+#include "metrics.h"
+#include "profile.h"
+
+extern long long current_time_ms();
 
 #ifdef _WIN32
 #include <windows.h>
@@ -37,6 +46,8 @@ int kbhit_check()
 #define NUM_CLASSES_TO_USE 10
 // ---------------------------
 
+#define HANDSHAKE_SEED 12345 // the host's RNG seed, sent in HANDSHAKE_RESPONSE
+
 // --- ROBUST CSV PARSING HELPER FOR SELECTION SCREEN ---
 
 static char *select_find_field(char *line, int index)
@@ -169,15 +180,63 @@ int load_pokemon_data_for_selection(char names[MAX_POKEMON_COUNT][MAX_NAME_LEN],
 
 void print_prompt(BattleContext *ctx)
 {
-    if (ctx->is_my_turn && ctx->state == STATE_WAITING_FOR_MOVE)
+    if (ctx->my_role != ROLE_SPECTATOR && ctx->is_my_turn && ctx->state == STATE_WAITING_FOR_MOVE)
     {
         printf("\rAction> ");
         fflush(stdout);
     }
 }
 
+// The opponent forfeits if it leaves the battle waiting too long
+static void on_turn_timeout(NetSession *s, void *arg)
+{
+    (void)s;
+    BattleContext *ctx = (BattleContext *)arg;
+    printf("\r[LOGIC] Opponent did not act for %d s, ending the battle\n", TURN_TIMEOUT_MS / 1000);
+    ctx->state = STATE_GAME_OVER;
+}
+
+// The clock restarts on every battle message from the opponent and stops
+// while the move is ours to make
+static void update_turn_timer(const BattleContext *ctx, bool progressed)
+{
+    NetSession *peer = net_primary_session();
+    if (!peer)
+        return;
+    if (!battle_awaiting_opponent(ctx))
+        net_session_cancel_turn_timer(peer);
+    else if (progressed || !net_session_turn_timer_armed(peer))
+        net_session_arm_turn_timer(peer, TURN_TIMEOUT_MS);
+}
+
+// What the banner shows; it is only redrawn when this changes
+typedef struct
+{
+    char my_pokemon[32];
+    char opponent_pokemon[32];
+    int my_hp;
+    int opponent_hp;
+    BattleState state;
+    bool is_my_turn;
+} BannerView;
+
 void print_battle_status(BattleContext *ctx)
 {
+    static BannerView shown;
+    static bool drawn = false;
+    BannerView now;
+    memset(&now, 0, sizeof(now));
+    memcpy(now.my_pokemon, ctx->my_pokemon, sizeof(now.my_pokemon));
+    memcpy(now.opponent_pokemon, ctx->opponent_pokemon, sizeof(now.opponent_pokemon));
+    now.my_hp = ctx->my_hp;
+    now.opponent_hp = ctx->opponent_hp;
+    now.state = ctx->state;
+    now.is_my_turn = ctx->is_my_turn;
+    if (drawn && memcmp(&now, &shown, sizeof(now)) == 0)
+        return;
+    shown = now;
+    drawn = true;
+
     printf("\n========================================\n");
     if (ctx->my_role == ROLE_SPECTATOR)
     {
@@ -225,16 +284,235 @@ void print_battle_status(BattleContext *ctx)
     print_prompt(ctx);
 }
 
+// --- SESSION & CHAT HANDLERS (registered into the game_logic dispatch table) ---
+
+static void on_handshake_request(BattleContext *ctx, GameMessage *msg)
+{
+    (void)msg;
+    ctx->rng_seed = HANDSHAKE_SEED;
+    char response[32];
+    snprintf(response, sizeof(response), "seed: %u\n", ctx->rng_seed);
+    net_send_game_message("HANDSHAKE_RESPONSE", response);
+    char setup[64];
+    snprintf(setup, sizeof(setup), "attacker: %s\n", ctx->my_pokemon);
+    net_send_game_message("BATTLE_SETUP", setup);
+}
+
+// This process plays one battle, against the primary session. Battle traffic
+// from any other session (a second joiner, strays) is dropped so it can't move
+// that battle along; spectator requests and chat may come from anyone.
+static bool accept_message(const GameMessage *msg)
+{
+    bool battle = msg->type == MSG_HANDSHAKE_REQUEST || msg->type == MSG_HANDSHAKE_RESPONSE ||
+                  msg->type == MSG_BATTLE_SNAPSHOT ||
+                  (msg->type >= MSG_BATTLE_SETUP && msg->type <= MSG_GAME_OVER);
+    return !battle || net_active_session() == net_primary_session();
+}
+
+// A multi-battle server keeps each battle in its session; a plain host only
+// has its own context (and its opponent is the primary session)
+static BattleContext *battle_view(NetSession *battle, BattleContext *ctx)
+{
+    return battle == net_primary_session() ? ctx : net_session_battle(battle);
+}
+
+static void send_snapshot_to_active(NetSession *battle, BattleContext *ctx)
+{
+    BattleContext *view = battle_view(battle, ctx);
+    if (view->my_pokemon[0] != '\0')
+        send_battle_snapshot(view, net_event_seq(battle));
+}
+
+static void on_spectator_request(BattleContext *ctx, GameMessage *msg)
+{
+    // battle_id picks a battle on a multi-battle server; a plain host has one
+    NetSession *battle = msg->battle_id ? net_find_session_by_id(msg->battle_id) : net_primary_session();
+    // On a sharded server the battle may be on another worker, which takes
+    // the spectator over and answers this request itself
+    if (!battle && msg->battle_id && net_hand_over_spectator(net_active_session(), msg->battle_id, msg))
+        return;
+    if (!net_watch_battle(net_active_session(), battle))
+    {
+        printf("[NET] Spectator refused (no battle %u).\n", msg->battle_id);
+        return;
+    }
+    printf("[NET] Spectator has joined.\n");
+    // Late joiners catch up from one snapshot instead of the whole history
+    if (battle)
+        send_snapshot_to_active(battle, ctx);
+}
+
+static void on_snapshot_request(BattleContext *ctx, GameMessage *msg)
+{
+    (void)msg;
+    NetSession *battle = net_watched_battle(net_active_session());
+    if (battle)
+        send_snapshot_to_active(battle, ctx);
+}
+
+static void on_handshake_response(BattleContext *ctx, GameMessage *msg)
+{
+    (void)msg;
+    if (ctx->my_role == ROLE_CLIENT)
+    {
+        char setup[64];
+        snprintf(setup, sizeof(setup), "attacker: %s\n", ctx->my_pokemon);
+        net_send_game_message("BATTLE_SETUP", setup);
+    }
+}
+
+static void on_chat_message(BattleContext *ctx, GameMessage *msg)
+{
+    (void)ctx;
+    ChatMessage cmsg;
+    if (parse_chat_message(msg->raw_buffer, &cmsg))
+    {
+        printf("\r");
+        display_chat_message(&cmsg);
+    }
+}
+
+static void on_sticker_message(BattleContext *ctx, GameMessage *msg)
+{
+    (void)ctx;
+    handle_sticker_message(msg->type, msg->raw_buffer);
+}
+
+// Offline: re-runs a recorded battle through the game logic, no network
+static int run_replay(const char *path)
+{
+    load_all_pokemon_and_moves("pokemon.csv");
+    JournalReplayResult res;
+    long long start = current_time_ms();
+    if (!journal_replay(path, &res, true))
+    {
+        printf("[REPLAY] Cannot read journal %s\n", path);
+        return 1;
+    }
+    printf("[REPLAY] %lu records (%lu received, %lu moves) in %lld ms; %lu/%lu states match\n",
+           res.records, res.messages, res.moves, current_time_ms() - start,
+           res.states - res.state_mismatches, res.states);
+    printf("[REPLAY] Final: %s %d HP vs %s %d HP after %u turns\n",
+           res.final.my_pokemon, res.final.my_hp, res.final.opponent_pokemon, res.final.opponent_hp,
+           res.final.turn_number);
+    return res.state_mismatches > 0 ? 2 : 0;
+}
+
+// Offline: jumps straight to one turn through the journal's index
+static int run_seek(const char *path, unsigned long turn)
+{
+    load_all_pokemon_and_moves("pokemon.csv");
+    JournalSeeker seeker;
+    if (!journal_seeker_open(&seeker, path))
+    {
+        printf("[REPLAY] Cannot read journal %s\n", path);
+        return 1;
+    }
+    BattleContext ctx;
+    bool found = journal_seek(&seeker, turn, &ctx);
+    unsigned long turns = seeker.turns;
+    journal_seeker_close(&seeker);
+    if (!found)
+    {
+        printf("[REPLAY] The journal has %lu turns\n", turns);
+        return 1;
+    }
+    printf("[REPLAY] After turn %lu of %lu (battle turn %u): %s %d HP vs %s %d HP, %s\n",
+           turn, turns, ctx.turn_number, ctx.my_pokemon, ctx.my_hp, ctx.opponent_pokemon, ctx.opponent_hp,
+           ctx.state == STATE_GAME_OVER ? "game over" : ctx.is_my_turn ? "my turn next" : "opponent next");
+    return 0;
+}
+
+// Offline: recomputes every turn of every journal in a directory
+static int run_verify(const char *dir, int threads)
+{
+    load_all_pokemon_and_moves("pokemon.csv");
+    VerifyTotals t;
+    long long start = current_time_ms();
+    if (!verify_journals(dir, threads, &t))
+    {
+        printf("[VERIFY] Cannot read directory %s\n", dir);
+        return 1;
+    }
+    long long ms = current_time_ms() - start;
+    printf("[VERIFY] Done: %lu journals (%lu unreadable, %lu truncated, %lu spectator) in %lld ms\n",
+           t.files, t.unreadable, t.truncated, t.spectator, ms);
+    printf("[VERIFY] %lu turns, %lu reports checked, %lu wrong, in %lu journals\n",
+           t.turns, t.reports, t.bad_reports, t.flagged_files);
+    return t.bad_reports > 0 ? 2 : 0;
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 3)
     {
-        printf("Usage: %s <host/join/spectate> <MyPort> [TargetIP] [TargetPort]\n", argv[0]);
+        printf("Usage: %s <host/join/spectate> <MyPort> [TargetIP] [TargetPort] [BattleId]\n", argv[0]);
+        printf("       %s server <MyPort> [Pokemon] [MaxSessions] [Workers]\n", argv[0]);
+        printf("       %s replay <JournalFile> [Turn]\n", argv[0]);
+        printf("       %s verify <JournalDir> [Threads]\n", argv[0]);
+        printf("       %s proxy <MyPort> <HostIP> <HostPort> [loss=0.05 dup= reorder= latency= jitter= rate= ...]\n",
+               argv[0]);
+        printf("       %s metrics <Port>\n", argv[0]);
+        printf("       %s loadgen <HostIP> <HostPort> <Clients> [Pokemon] [Move] [Seconds] [Threads]\n", argv[0]);
         return 1;
     }
+    if (strcmp(argv[1], "replay") == 0)
+        return argc > 3 ? run_seek(argv[2], strtoul(argv[3], NULL, 10)) : run_replay(argv[2]);
+    if (strcmp(argv[1], "verify") == 0)
+        return run_verify(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+    if (strcmp(argv[1], "proxy") == 0)
+    {
+        ProxyConfig cfg;
+        proxy_default_config(&cfg);
+        if (argc < 5)
+        {
+            printf("Usage: %s proxy <MyPort> <HostIP> <HostPort> [key=value ...]\n", argv[0]);
+            return 1;
+        }
+        for (int i = 5; i < argc; i++)
+        {
+            if (!proxy_parse_option(&cfg, argv[i]))
+            {
+                printf("[PROXY] Unknown option %s\n", argv[i]);
+                return 1;
+            }
+        }
+        return run_proxy(atoi(argv[2]), argv[3], atoi(argv[4]), &cfg);
+    }
+    if (strcmp(argv[1], "metrics") == 0)
+        return run_metrics_query(atoi(argv[2]));
+    if (strcmp(argv[1], "loadgen") == 0)
+    {
+        if (argc < 5)
+        {
+            printf("Usage: %s loadgen <HostIP> <HostPort> <Clients> [Pokemon] [Move] [Seconds] [Threads]\n", argv[0]);
+            return 1;
+        }
+        srand(time(NULL));
+        return run_loadgen(argv[2], atoi(argv[3]), atoi(argv[4]), argc > 5 ? argv[5] : NULL, argc > 6 ? argv[6] : NULL,
+                           argc > 7 ? atoi(argv[7]) : 0, argc > 8 ? atoi(argv[8]) : 1);
+    }
 
     srand(time(NULL));
     int my_port = atoi(argv[2]);
+
+    register_message_handler(MSG_HANDSHAKE_REQUEST, on_handshake_request);
+    register_message_handler(MSG_SPECTATOR_REQUEST, on_spectator_request);
+    register_message_handler(MSG_SNAPSHOT_REQUEST, on_snapshot_request);
+    register_message_handler(MSG_HANDSHAKE_RESPONSE, on_handshake_response);
+
+    if (strcmp(argv[1], "server") == 0)
+        return run_server(my_port, argc > 3 ? argv[3] : "Charizard", argc > 4 ? atoi(argv[4]) : 0,
+                          argc > 5 ? atoi(argv[5]) : 1);
+
+    // Chat and stickers are for the one player at this terminal. The sticker
+    // transfer table is process-wide and only chat_pump() moves it on, so a
+    // server's workers leave these messages alone.
+    register_message_handler(MSG_CHAT_MESSAGE, on_chat_message);
+    register_message_handler(MSG_STICKER_OFFER, on_sticker_message);
+    register_message_handler(MSG_STICKER_CHUNK, on_sticker_message);
+    register_message_handler(MSG_STICKER_ACK, on_sticker_message);
+
     if (!net_init(my_port))
         return 1;
 
@@ -378,12 +656,15 @@ int main(int argc, char *argv[])
     {
         net_set_peer(argv[3], atoi(argv[4]));
         net_send_game_message("HANDSHAKE_REQUEST", NULL);
-        printf("[MAIN] Sending Join Request...\n");
+        printf("[MAIN] Sending Join Request... (battle id %u)\n", net_session_id(net_primary_session()));
     }
     else if (role == ROLE_SPECTATOR)
     {
         net_set_peer(argv[3], atoi(argv[4]));
-        net_send_game_message("SPECTATOR_REQUEST", NULL);
+        char watch[48] = "";
+        if (argc > 5)
+            snprintf(watch, sizeof(watch), "battle_id: %s\n", argv[5]);
+        net_send_game_message("SPECTATOR_REQUEST", watch);
         printf("[MAIN] Sending Spectator Request...\n");
     }
     else
@@ -391,65 +672,69 @@ int main(int argc, char *argv[])
         printf("[MAIN] Hosting on port %d...\n", my_port);
     }
 
+    ctx.journal = journal_create(net_is_peer_set() ? net_session_id(net_primary_session()) : 0, 0, 0);
+    journal_record_begin(ctx.journal, ctx.my_role, ctx.my_pokemon);
+
     char input_buffer[100];
     GameMessage msg;
 
+    net_set_turn_timeout_handler(on_turn_timeout, &ctx);
+#ifndef _WIN32
+    net_set_wake_fd(0); // typing wakes the loop as promptly as a datagram
+#endif
+
     while (ctx.state != STATE_GAME_OVER)
     {
+        PROFILE_BEGIN(loop_timer, PROF_EVENT_LOOP);
+
         // --- NETWORK POLLING ---
-        if (net_process_updates(&msg))
+        if (net_process_updates(&msg) && accept_message(&msg))
         {
-            printf("\r                                     \r"); // Clear line
+            // Sticker streaming runs in the background without touching the prompt
+            bool bulk = msg.type == MSG_STICKER_CHUNK || msg.type == MSG_STICKER_ACK;
+            if (!bulk)
+                printf("\r                                     \r"); // Clear line
 
-            // Handshake logic
-            if (strcmp(msg.message_type, "HANDSHAKE_REQUEST") == 0)
-            {
-                net_send_game_message("HANDSHAKE_RESPONSE", "seed: 12345\n");
-                char setup[64];
-                snprintf(setup, sizeof(setup), "attacker: %s\n", ctx.my_pokemon);
-                net_send_game_message("BATTLE_SETUP", setup);
-            }
-            else if (strcmp(msg.message_type, "SPECTATOR_REQUEST") == 0)
-            {
-                printf("[NET] Spectator has joined.\n");
-            }
-            else if (strcmp(msg.message_type, "HANDSHAKE_RESPONSE") == 0)
-            {
-                if (role == ROLE_CLIENT)
-                {
-                    char setup[64];
-                    snprintf(setup, sizeof(setup), "attacker: %s\n", ctx.my_pokemon);
-                    net_send_game_message("BATTLE_SETUP", setup);
-                }
-            }
-            else
-            {
-                // Chat?
-                ChatMessage cmsg;
-                if (parse_chat_message(msg.raw_buffer, &cmsg))
-                {
-                    printf("\r");
-                    display_chat_message(&cmsg);
-                    print_prompt(&ctx);
-                    continue;
-                }
+            process_incoming_message(&ctx, &msg);
+            update_turn_timer(&ctx, net_active_session() == net_primary_session() &&
+                                        msg.type >= MSG_BATTLE_SETUP && msg.type <= MSG_GAME_OVER);
 
-                // Game event
-                process_incoming_message(&ctx, &msg);
+            // Session and chat traffic doesn't change the battle banner
+            switch (msg.type)
+            {
+            case MSG_HANDSHAKE_REQUEST:
+            case MSG_HANDSHAKE_RESPONSE:
+            case MSG_SPECTATOR_REQUEST:
+            case MSG_SNAPSHOT_REQUEST:
+            case MSG_CHAT_MESSAGE:
+            case MSG_STICKER_OFFER:
+            case MSG_STICKER_CHUNK:
+            case MSG_STICKER_ACK:
+                break;
+            default:
                 print_battle_status(&ctx);
+                break;
             }
 
-            print_prompt(&ctx);
+            if (!bulk)
+                print_prompt(&ctx);
         }
 
         // --- PLAYER INPUT ---
         if (kbhit_check())
         {
+            // Replies above went to whoever sent; our own moves and chat go to the opponent
+            net_select_session(net_primary_session());
+
             if (fgets(input_buffer, sizeof(input_buffer), stdin))
             {
                 input_buffer[strcspn(input_buffer, "\n")] = 0;
 
-                if (ctx.my_role == ROLE_SPECTATOR)
+                if (strncmp(input_buffer, "/sticker ", 9) == 0 && ctx.my_role != ROLE_SPECTATOR)
+                {
+                    send_chat_sticker(role == ROLE_HOST ? "Host" : "Joiner", input_buffer + 9);
+                }
+                else if (ctx.my_role == ROLE_SPECTATOR)
                 {
                     printf("\r[CHAT] Spectator: %s\n", input_buffer);
                     net_send_chat("Spectator", input_buffer);
@@ -457,6 +742,7 @@ int main(int argc, char *argv[])
                 else if (ctx.is_my_turn && ctx.state == STATE_WAITING_FOR_MOVE)
                 {
                     execute_move_command(&ctx, input_buffer);
+                    update_turn_timer(&ctx, true);
                 }
                 else
                 {
@@ -466,12 +752,35 @@ int main(int argc, char *argv[])
 
                 print_prompt(&ctx);
             }
+#ifndef _WIN32
+            else
+            {
+                net_set_wake_fd(-1); // stdin closed: stop waking on it
+            }
+#endif
         }
 
-        sleep_ms(10);
+        PROFILE_END(loop_timer);
+
+        // Sleep until a datagram, a keystroke or the next deadline
+        int wake_ms = chat_pump();
+#ifdef _WIN32
+        if (wake_ms < 0 || wake_ms > 10)
+            wake_ms = 10; // the console can't wake select(), so poll it
+#endif
+        net_wait(wake_ms);
     }
 
-    printf("\nGAME OVER! Winner: %s\n", ctx.my_hp > 0 ? "You" : "Opponent");
+    if (ctx.my_role == ROLE_SPECTATOR)
+        printf("\nGAME OVER! Winner: %s\n", ctx.my_hp > 0 ? ctx.my_pokemon : ctx.opponent_pokemon);
+    else
+        printf("\nGAME OVER! Winner: %s\n", ctx.my_hp > 0 ? "You" : "Opponent");
+    ResolutionStats rs = get_resolution_stats();
+    if (rs.requested > 0)
+        printf("[LOGIC] Discrepancies: %llu, resolved: %llu, our result corrected: %llu\n",
+               rs.requested, rs.resolved, rs.corrected);
+    journal_close(ctx.journal);
+    journal_shutdown();
     net_cleanup();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #include <windows.h>
+    typedef SOCKET metrics_socket;
+#else
+    #include <unistd.h>
+    #include <arpa/inet.h>
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #define INVALID_SOCKET -1
+    #define closesocket close
+    typedef int metrics_socket;
+#endif
+
+#if defined(_MSC_VER)
+    #define METRICS_THREAD_LOCAL __declspec(thread)
+#else
+    #define METRICS_THREAD_LOCAL __thread
+#endif
+
+static const char *COUNTER_NAMES[METRIC_COUNTER_COUNT] = {
+    [METRIC_DATAGRAMS_SENT] = "datagrams_sent",
+    [METRIC_DATAGRAMS_RECEIVED] = "datagrams_received",
+    [METRIC_BYTES_SENT] = "bytes_sent",
+    [METRIC_BYTES_RECEIVED] = "bytes_received",
+    [METRIC_RETRANSMITS] = "retransmits",
+    [METRIC_DUPLICATES] = "duplicates_dropped",
+    [METRIC_OUT_OF_ORDER] = "out_of_order_dropped",
+    [METRIC_RETRY_STALLS] = "retry_stalls",
+    [METRIC_TURNS] = "turns",
+};
+
+static const char *HISTOGRAM_NAMES[METRIC_HISTOGRAM_COUNT] = {
+    [METRIC_ACK_RTT] = "ack_rtt_us",
+    [METRIC_TURN_TIME] = "turn_time_us",
+};
+
+// One thread's metrics on cache lines of their own
+typedef struct {
+    MetricsSnapshot m;
+} __attribute__((aligned(64))) MetricsSlot;
+
+static MetricsSlot slots[METRICS_MAX_SLOTS];
+static int slots_claimed;
+static METRICS_THREAD_LOCAL MetricsSlot *mine;
+
+static MetricsSlot *my_slot(void) {
+    if (!mine) {
+        int i = __atomic_fetch_add(&slots_claimed, 1, __ATOMIC_RELAXED);
+        mine = &slots[i < METRICS_MAX_SLOTS ? i : METRICS_MAX_SLOTS - 1];
+    }
+    return mine;
+}
+
+long long metrics_now_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, t;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (long long)(t.QuadPart * 1000000.0 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+}
+
+// --- Recording ---
+void metrics_add(MetricCounter c, unsigned long long n) {
+    __atomic_fetch_add(&my_slot()->m.counters[c], n, __ATOMIC_RELAXED);
+}
+
+static int bucket_of(long long us) {
+    if (us < 1) return 0;
+    int b = 64 - __builtin_clzll((unsigned long long)us);
+    return b < METRICS_BUCKETS ? b : METRICS_BUCKETS - 1;
+}
+
+void metrics_observe(MetricHistogram h, long long us) {
+    MetricHistogramData *d = &my_slot()->m.histograms[h];
+    __atomic_fetch_add(&d->buckets[bucket_of(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->sum_us, (unsigned long long)(us > 0 ? us : 0), __ATOMIC_RELAXED);
+}
+
+// --- Reading ---
+void metrics_snapshot(MetricsSnapshot *out) {
+    memset(out, 0, sizeof(*out));
+    int n = __atomic_load_n(&slots_claimed, __ATOMIC_RELAXED);
+    if (n > METRICS_MAX_SLOTS) n = METRICS_MAX_SLOTS;
+    for (int i = 0; i < n; i++) {
+        const MetricsSnapshot *m = &slots[i].m;
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+            out->counters[c] += __atomic_load_n(&m->counters[c], __ATOMIC_RELAXED);
+        for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+            const MetricHistogramData *src = &m->histograms[h];
+            MetricHistogramData *dst = &out->histograms[h];
+            for (int b = 0; b < METRICS_BUCKETS; b++)
+                dst->buckets[b] += __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+            dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+            dst->sum_us += __atomic_load_n(&src->sum_us, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+long long metrics_percentile_us(const MetricHistogramData *h, double q) {
+    unsigned long long total = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) total += h->buckets[b];
+    if (total == 0) return 0;
+    unsigned long long rank = (unsigned long long)(q * total);
+    if (rank >= total) rank = total - 1;
+    unsigned long long seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) return 1LL << b;
+    }
+    return 1LL << (METRICS_BUCKETS - 1);
+}
+
+int metrics_format(char *buf, size_t size) {
+    MetricsSnapshot s;
+    metrics_snapshot(&s);
+    int len = 0;
+    for (int c = 0; c < METRIC_COUNTER_COUNT && len < (int)size; c++)
+        len += snprintf(buf + len, size - len, "%s %llu\n", COUNTER_NAMES[c], s.counters[c]);
+    for (int h = 0; h < METRIC_HISTOGRAM_COUNT && len < (int)size; h++) {
+        const MetricHistogramData *d = &s.histograms[h];
+        len += snprintf(buf + len, size - len, "%s count %llu mean %llu p50 %lld p90 %lld p99 %lld\n",
+                        HISTOGRAM_NAMES[h], d->count, d->count ? d->sum_us / d->count : 0,
+                        metrics_percentile_us(d, 0.50), metrics_percentile_us(d, 0.90),
+                        metrics_percentile_us(d, 0.99));
+    }
+    return len < (int)size ? len : (int)size - 1;
+}
+
+void metrics_print_line(const char *prefix) {
+    MetricsSnapshot s;
+    metrics_snapshot(&s);
+    const unsigned long long *c = s.counters;
+    const MetricHistogramData *rtt = &s.histograms[METRIC_ACK_RTT];
+    const MetricHistogramData *turn = &s.histograms[METRIC_TURN_TIME];
+    printf("%s tx %llu dgrams/%llu KB | rx %llu dgrams/%llu KB | retransmits %llu | dup dropped %llu | "
+           "out of order %llu | stalled %llu | rtt p50 %lld p99 %lld us | %llu turns, p50 %lld p99 %lld us\n",
+           prefix, c[METRIC_DATAGRAMS_SENT], c[METRIC_BYTES_SENT] / 1024, c[METRIC_DATAGRAMS_RECEIVED],
+           c[METRIC_BYTES_RECEIVED] / 1024, c[METRIC_RETRANSMITS], c[METRIC_DUPLICATES], c[METRIC_OUT_OF_ORDER],
+           c[METRIC_RETRY_STALLS], metrics_percentile_us(rtt, 0.50), metrics_percentile_us(rtt, 0.99),
+           c[METRIC_TURNS], metrics_percentile_us(turn, 0.50), metrics_percentile_us(turn, 0.99));
+}
+
+// --- Query ---
+int run_metrics_query(int port) {
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return 1;
+#endif
+    metrics_socket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == INVALID_SOCKET) {
+        printf("[METRICS] Could not open a socket\n");
+        return 1;
+    }
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(sock, METRICS_REQUEST, (int)strlen(METRICS_REQUEST), 0, (struct sockaddr *)&addr, sizeof(addr));
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    struct timeval tv = {1, 0};
+    char reply[8192];
+    int len = -1;
+    if (select((int)sock + 1, &fds, NULL, NULL, &tv) > 0) len = (int)recv(sock, reply, sizeof(reply) - 1, 0);
+    closesocket(sock);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    if (len <= 0) {
+        printf("[METRICS] No answer from port %d\n", port);
+        return 1;
+    }
+    reply[len] = '\0';
+    fputs(reply, stdout);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+// Process-wide network and protocol metrics. Each thread updates its own
+// cache-line-aligned slot with relaxed atomics, so recording never takes a
+// lock or shares a line with another worker; readers sum every slot.
+// Histograms keep log2 buckets of microseconds.
+
+#define METRICS_MAX_SLOTS 64     // threads with a slot of their own; the rest share the last
+#define METRICS_BUCKETS 32       // bucket i holds [2^(i-1), 2^i) µs, bucket 0 under 1 µs
+#define METRICS_DUMP_MS 10000    // how often the server prints its [METRICS] line
+#define METRICS_REQUEST "message_type: METRICS_REQUEST\n" // see run_metrics_query()
+
+typedef enum {
+    METRIC_DATAGRAMS_SENT = 0,
+    METRIC_DATAGRAMS_RECEIVED,
+    METRIC_BYTES_SENT,
+    METRIC_BYTES_RECEIVED,
+    METRIC_RETRANSMITS,
+    METRIC_DUPLICATES,   // seq <= remote_seq: delivered before, dropped
+    METRIC_OUT_OF_ORDER, // past a gap, dropped until its retry
+    METRIC_RETRY_STALLS, // still unacknowledged after MAX_RETRIES
+    METRIC_TURNS,
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+typedef enum {
+    METRIC_ACK_RTT = 0, // first transmission to its ACK; retransmitted frames aren't sampled
+    METRIC_TURN_TIME,   // ATTACK_ANNOUNCE sent or received to the end of the turn
+    METRIC_HISTOGRAM_COUNT
+} MetricHistogram;
+
+typedef struct {
+    unsigned long long buckets[METRICS_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum_us;
+} MetricHistogramData;
+
+typedef struct {
+    unsigned long long counters[METRIC_COUNTER_COUNT];
+    MetricHistogramData histograms[METRIC_HISTOGRAM_COUNT];
+} MetricsSnapshot;
+
+void metrics_add(MetricCounter c, unsigned long long n);
+void metrics_observe(MetricHistogram h, long long us);
+long long metrics_now_us(void);
+
+// Sums every thread's slot (the values keep moving while it reads)
+void metrics_snapshot(MetricsSnapshot *out);
+// Upper edge of the bucket holding quantile q (0..1), 0 without samples
+long long metrics_percentile_us(const MetricHistogramData *h, double q);
+// One "name value" line per counter and a summary line per histogram
+int metrics_format(char *buf, size_t size);
+// Everything on one line, for periodic logs
+void metrics_print_line(const char *prefix);
+
+// Asks a running instance on 127.0.0.1:port for its metrics and prints them.
+// Only loopback senders get an answer.
+int run_metrics_query(int port);
+
+#endif
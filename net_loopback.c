@@ -0,0 +1,214 @@
+#include "net_loopback.h"
+#include "net_transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOOPBACK_EPOCH_MS 1000 // where the virtual clock starts
+
+// A datagram in flight, queued at its destination in arrival order
+typedef struct LoopbackPacket {
+    long long deliver_at;
+    unsigned long long order; // send order breaks ties, so equal delays stay FIFO
+    struct sockaddr_in from;
+    int len;
+    struct LoopbackPacket *next;
+    char data[]; // NUL-terminated
+} LoopbackPacket;
+
+typedef struct LoopbackEndpoint {
+    NetTransport base;
+    NetLoopback *lb;
+    struct sockaddr_in addr;
+    LoopbackPacket *inbox;
+    LoopbackPacket *handed[NET_IO_BATCH]; // last recv_batch's, freed on the next
+    int handed_count;
+    struct LoopbackEndpoint *next;
+} LoopbackEndpoint;
+
+struct NetLoopback {
+    NetLoopbackConfig cfg;
+    long long now;
+    unsigned long long order;
+    unsigned int rng;
+    LoopbackEndpoint *endpoints;
+    NetLoopbackStats stats;
+};
+
+// xorshift32: cheap, and identical on every platform for a given seed
+static unsigned int next_rand(NetLoopback *lb) {
+    unsigned int x = lb->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return lb->rng = x;
+}
+
+static bool chance(NetLoopback *lb, double p) {
+    return p > 0 && (next_rand(lb) / 4294967296.0) < p;
+}
+
+NetLoopback *net_loopback_create(const NetLoopbackConfig *cfg) {
+    NetLoopback *lb = calloc(1, sizeof(NetLoopback));
+    if (!lb) return NULL;
+    if (cfg) lb->cfg = *cfg;
+    lb->rng = lb->cfg.seed ? lb->cfg.seed : 0x9e3779b9u;
+    lb->now = LOOPBACK_EPOCH_MS;
+    return lb;
+}
+
+void net_loopback_destroy(NetLoopback *lb) {
+    free(lb);
+}
+
+long long net_loopback_now(const NetLoopback *lb) { return lb->now; }
+NetLoopbackStats net_loopback_stats(const NetLoopback *lb) { return lb->stats; }
+
+void net_loopback_advance_to(NetLoopback *lb, long long ms) {
+    if (ms > lb->now) lb->now = ms;
+}
+
+long long net_loopback_next_delivery(const NetLoopback *lb) {
+    long long next = -1;
+    for (const LoopbackEndpoint *e = lb->endpoints; e; e = e->next)
+        if (e->inbox && (next < 0 || e->inbox->deliver_at < next)) next = e->inbox->deliver_at;
+    return next;
+}
+
+// --- Transport ---
+static LoopbackEndpoint *find_endpoint(NetLoopback *lb, const struct sockaddr_in *addr) {
+    for (LoopbackEndpoint *e = lb->endpoints; e; e = e->next)
+        if (e->addr.sin_port == addr->sin_port) return e;
+    return NULL;
+}
+
+static void enqueue(LoopbackEndpoint *to, const LoopbackEndpoint *from, const NetDatagram *d, long long at) {
+    NetLoopback *lb = to->lb;
+    LoopbackPacket *p = malloc(sizeof(LoopbackPacket) + (size_t)d->head_len + (size_t)d->len + 1);
+    if (!p) return;
+    p->deliver_at = at;
+    p->order = lb->order++;
+    p->from = from->addr;
+    p->len = d->head_len + d->len;
+    if (d->head_len) memcpy(p->data, d->head, (size_t)d->head_len);
+    memcpy(p->data + d->head_len, d->data, (size_t)d->len);
+    p->data[p->len] = '\0';
+
+    LoopbackPacket **link = &to->inbox;
+    while (*link && ((*link)->deliver_at < at || ((*link)->deliver_at == at && (*link)->order < p->order)))
+        link = &(*link)->next;
+    p->next = *link;
+    *link = p;
+}
+
+static long long delivery_time(NetLoopback *lb) {
+    long long at = lb->now + lb->cfg.latency_ms;
+    if (lb->cfg.jitter_ms > 0) at += next_rand(lb) % (unsigned int)(lb->cfg.jitter_ms + 1);
+    if (chance(lb, lb->cfg.reorder)) {
+        at += lb->cfg.reorder_ms;
+        lb->stats.reordered++;
+    }
+    return at;
+}
+
+static int loopback_send_batch(NetTransport *t, const NetDatagram *dgrams, int n) {
+    LoopbackEndpoint *e = (LoopbackEndpoint *)t;
+    NetLoopback *lb = e->lb;
+    for (int i = 0; i < n; i++) {
+        lb->stats.sent++;
+        LoopbackEndpoint *to = find_endpoint(lb, &dgrams[i].addr);
+        if (!to || chance(lb, lb->cfg.loss)) {
+            lb->stats.dropped++;
+            continue;
+        }
+        enqueue(to, e, &dgrams[i], delivery_time(lb));
+        if (chance(lb, lb->cfg.duplicate)) {
+            enqueue(to, e, &dgrams[i], delivery_time(lb));
+            lb->stats.duplicated++;
+        }
+    }
+    if (n > 0) {
+        t->stats->tx_packets += (unsigned long long)n;
+        t->stats->tx_syscalls++;
+    }
+    return n;
+}
+
+static void release_handed(LoopbackEndpoint *e) {
+    for (int i = 0; i < e->handed_count; i++) free(e->handed[i]);
+    e->handed_count = 0;
+}
+
+static int loopback_recv_batch(NetTransport *t, NetDatagram *out, int max) {
+    LoopbackEndpoint *e = (LoopbackEndpoint *)t;
+    release_handed(e);
+    if (max > NET_IO_BATCH) max = NET_IO_BATCH;
+    int n = 0;
+    while (n < max && e->inbox && e->inbox->deliver_at <= e->lb->now) {
+        LoopbackPacket *p = e->inbox;
+        e->inbox = p->next;
+        e->handed[e->handed_count++] = p;
+        out[n].addr = p->from;
+        out[n].head = NULL;
+        out[n].head_len = 0;
+        out[n].data = p->data;
+        out[n].len = p->len;
+        n++;
+    }
+    e->lb->stats.delivered += (unsigned long long)n;
+    t->stats->rx_syscalls++;
+    if (n == 0) t->stats->rx_empty_polls++;
+    t->stats->rx_packets += (unsigned long long)n;
+    return n;
+}
+
+// Time only moves when the caller says so, so there is nothing to block on
+static bool loopback_wait(NetTransport *t, int timeout_ms) {
+    (void)timeout_ms;
+    LoopbackEndpoint *e = (LoopbackEndpoint *)t;
+    return e->inbox && e->inbox->deliver_at <= e->lb->now;
+}
+
+static long long loopback_now(NetTransport *t) {
+    return ((LoopbackEndpoint *)t)->lb->now;
+}
+
+static void loopback_destroy(NetTransport *t) {
+    LoopbackEndpoint *e = (LoopbackEndpoint *)t;
+    release_handed(e);
+    while (e->inbox) {
+        LoopbackPacket *p = e->inbox;
+        e->inbox = p->next;
+        free(p);
+    }
+    for (LoopbackEndpoint **link = &e->lb->endpoints; *link; link = &(*link)->next) {
+        if (*link == e) {
+            *link = e->next;
+            break;
+        }
+    }
+    free(e);
+}
+
+NetWorker *net_loopback_worker_create(NetLoopback *lb, int port, int max_sessions, bool multi_battle) {
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    if (find_endpoint(lb, &addr)) return NULL; // port taken, as bind() would say
+
+    LoopbackEndpoint *e = calloc(1, sizeof(LoopbackEndpoint));
+    if (!e) return NULL;
+    e->base.name = "loopback";
+    e->base.recv_batch = loopback_recv_batch;
+    e->base.send_batch = loopback_send_batch;
+    e->base.wait = loopback_wait;
+    e->base.destroy = loopback_destroy;
+    e->base.now = loopback_now;
+    e->base.wake_fd = -1;
+    e->lb = lb;
+    e->addr = addr;
+    e->next = lb->endpoints;
+    lb->endpoints = e;
+    return net_worker_create_on(&e->base, max_sessions, multi_battle);
+}
@@ -0,0 +1,50 @@
+#ifndef NET_LOOPBACK_H
+#define NET_LOOPBACK_H
+
+#include <stdbool.h>
+#include "network.h"
+
+// In-process datagram network for tests and tools. Workers created on it
+// trade datagrams through memory and share its virtual clock, so whole
+// battles run without sockets or sleeps: the caller moves the clock on to
+// the next event itself. Loss, duplication, reordering and latency come from
+// a seeded PRNG, so a run with the same seed always plays out the same way.
+// Single-threaded: every worker on one loopback runs on the same thread.
+
+typedef struct {
+    double loss;      // chance a datagram is dropped
+    double duplicate; // chance it is delivered twice
+    double reorder;   // chance it is held back reorder_ms past later ones
+    int latency_ms;   // one-way delay
+    int jitter_ms;    // plus 0..jitter_ms
+    int reorder_ms;
+    unsigned int seed;
+} NetLoopbackConfig;
+
+typedef struct {
+    unsigned long long sent;
+    unsigned long long delivered;
+    unsigned long long dropped;    // by loss, or sent to a port nobody has
+    unsigned long long duplicated;
+    unsigned long long reordered;
+} NetLoopbackStats;
+
+typedef struct NetLoopback NetLoopback;
+
+// NULL cfg: a perfect link with no delay
+NetLoopback *net_loopback_create(const NetLoopbackConfig *cfg);
+// Destroy its workers first
+void net_loopback_destroy(NetLoopback *lb);
+
+// A worker at 127.0.0.1:port on this network; everything else is as with
+// net_worker_create() (net_set_peer("127.0.0.1", other_port) to join)
+NetWorker *net_loopback_worker_create(NetLoopback *lb, int port, int max_sessions, bool multi_battle);
+
+long long net_loopback_now(const NetLoopback *lb);
+// Moves the clock forward (never back)
+void net_loopback_advance_to(NetLoopback *lb, long long ms);
+// When the next datagram in flight arrives, -1 if none is
+long long net_loopback_next_delivery(const NetLoopback *lb);
+NetLoopbackStats net_loopback_stats(const NetLoopback *lb);
+
+#endif
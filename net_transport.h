@@ -0,0 +1,56 @@
+#ifndef NET_TRANSPORT_H
+#define NET_TRANSPORT_H
+
+// Datagram transports underneath network.c. Only the network layer and the
+// transport implementations include this.
+
+#include <stdbool.h>
+#include "network.h"
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+#endif
+
+typedef struct {
+    struct sockaddr_in addr;
+    const char *head;  // optional prefix sent before data (e.g. a per-recipient header)
+    int head_len;
+    char *data;        // received data is NUL-terminated
+    int len;
+} NetDatagram;
+
+typedef struct NetTransport NetTransport;
+struct NetTransport {
+    const char *name;
+    // Receives up to max datagrams; their data stays valid until the next call
+    int (*recv_batch)(NetTransport *t, NetDatagram *out, int max);
+    // Sends n datagrams; returns how many went out
+    int (*send_batch)(NetTransport *t, const NetDatagram *dgrams, int n);
+    // Blocks up to timeout_ms (< 0: no limit) until recv_batch would return
+    // something or wake_fd turns readable
+    bool (*wait)(NetTransport *t, int timeout_ms);
+    void (*destroy)(NetTransport *t);
+    NetIoStats *stats; // the owning worker's counters
+    int wake_fd;       // extra fd wait() watches (e.g. stdin), -1 for none
+    // Optional clock for every deadline on the worker; NULL: current_time_ms()
+    long long (*now)(NetTransport *t);
+};
+
+// A worker on a transport that isn't a socket of its own (the worker owns t
+// from here on, and points t->stats at its counters)
+NetWorker *net_worker_create_on(NetTransport *t, int capacity, bool multi_battle);
+
+// recvmmsg/sendmmsg (Linux) or recvfrom/sendto on a bound, non-blocking socket
+NetTransport *net_socket_transport_create(int sockfd, NetIoStats *stats);
+
+#ifdef NET_USE_IO_URING
+// Multishot receives into a registered buffer ring, batched sends; NULL if
+// the kernel doesn't support it (callers fall back to the socket transport)
+NetTransport *net_uring_transport_create(int sockfd, NetIoStats *stats);
+#endif
+
+#endif
@@ -0,0 +1,355 @@
+// io_uring transport (Linux, build with -DNET_USE_IO_URING).
+// One multishot RECVMSG stays armed on the socket and fills buffers from a
+// registered buffer ring, so a busy socket is drained without a syscall per
+// batch; sends go out as one SENDMSG per datagram, submitted together.
+// Talks to the kernel directly rather than through liburing.
+#if defined(__linux__) && defined(NET_USE_IO_URING)
+#define _GNU_SOURCE
+#include "net_transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_SQ_ENTRIES 64
+#define URING_CQ_ENTRIES 1024
+#define URING_BUF_COUNT 128 // power of two
+#define URING_BGID 1
+#define URING_TAG_RECV 1
+#define URING_TAG_SEND 2
+
+// Each provided buffer: recvmsg_out header, sender address, payload, NUL
+#define URING_BUF_HEAD (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in))
+#define URING_BUF_SIZE (URING_BUF_HEAD + NET_MAX_DATAGRAM + 1)
+
+typedef struct {
+    int res;
+    unsigned flags;
+} HeldCqe;
+
+typedef struct {
+    NetTransport base;
+    int sockfd;
+    int ring_fd;
+
+    // Submission ring
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned sq_pending; // SQEs written but not yet submitted
+
+    // Completion ring (shares sq_ptr when the kernel allows a single mmap)
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Provided buffers
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *bufs;
+    unsigned short buf_tail;
+    unsigned short lent[NET_IO_BATCH]; // handed to the caller until the next recv_batch
+    int lent_count;
+
+    // Receive completions reaped while waiting for sends
+    HeldCqe held[URING_CQ_ENTRIES];
+    int held_head, held_count;
+
+    struct msghdr recv_msg;
+    bool recv_armed;
+} UringTransport;
+
+// --- Kernel Interface ---
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// --- Rings ---
+static struct io_uring_sqe *get_sqe(UringTransport *u) {
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *u->sq_tail;
+    if (tail - head >= URING_SQ_ENTRIES) return NULL;
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->sq_pending++;
+    return sqe;
+}
+
+static void recycle_buffer(UringTransport *u, unsigned short bid) {
+    struct io_uring_buf *b = &u->buf_ring->bufs[u->buf_tail & (URING_BUF_COUNT - 1)];
+    b->addr = (unsigned long)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+    b->len = URING_BUF_SIZE - 1; // keep the last byte for the NUL
+    b->bid = bid;
+    u->buf_tail++;
+}
+
+static void publish_buffers(UringTransport *u) {
+    __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void arm_recv(UringTransport *u) {
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) return; // retried on the next recv_batch
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = u->sockfd;
+    sqe->addr = (unsigned long)&u->recv_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = URING_TAG_RECV;
+    u->recv_armed = true;
+}
+
+// Pulls every ready CQE; sends are counted, receives are queued in held[]
+static int reap(UringTransport *u) {
+    int sends = 0;
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        if (cqe->user_data == URING_TAG_SEND) {
+            sends++;
+        } else if (cqe->user_data == URING_TAG_RECV) {
+            if (!(cqe->flags & IORING_CQE_F_MORE)) u->recv_armed = false;
+            if (u->held_count < URING_CQ_ENTRIES) {
+                int slot = (u->held_head + u->held_count) % URING_CQ_ENTRIES;
+                u->held[slot].res = cqe->res;
+                u->held[slot].flags = cqe->flags;
+                u->held_count++;
+            } else if (cqe->flags & IORING_CQE_F_BUFFER) {
+                recycle_buffer(u, (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+        }
+        head++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    return sends;
+}
+
+// --- Transport Ops ---
+static int uring_recv_batch(NetTransport *t, NetDatagram *out, int max) {
+    UringTransport *u = (UringTransport *)t;
+
+    // The caller is done with the previous batch
+    for (int i = 0; i < u->lent_count; i++) recycle_buffer(u, u->lent[i]);
+    u->lent_count = 0;
+    publish_buffers(u);
+
+    reap(u);
+    if (!u->recv_armed) arm_recv(u);
+    if (u->sq_pending) {
+        uring_enter(u->ring_fd, u->sq_pending, 0, 0);
+        u->sq_pending = 0;
+        t->stats->rx_syscalls++;
+    }
+
+    int n = 0;
+    if (max > NET_IO_BATCH) max = NET_IO_BATCH;
+    while (n < max && u->held_count > 0) {
+        HeldCqe c = u->held[u->held_head];
+        u->held_head = (u->held_head + 1) % URING_CQ_ENTRIES;
+        u->held_count--;
+        if (!(c.flags & IORING_CQE_F_BUFFER)) continue; // -ENOBUFS etc.; re-armed above
+        unsigned short bid = (unsigned short)(c.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (c.res <= 0) {
+            recycle_buffer(u, bid);
+            continue;
+        }
+        char *buf = u->bufs + (size_t)bid * URING_BUF_SIZE;
+        struct io_uring_recvmsg_out *o = (struct io_uring_recvmsg_out *)buf;
+        char *payload = buf + sizeof(*o) + u->recv_msg.msg_namelen + u->recv_msg.msg_controllen;
+        int avail = c.res - (int)(payload - buf);
+        int len = (int)o->payloadlen < avail ? (int)o->payloadlen : avail;
+        if (len < 0) len = 0;
+        if (len > NET_MAX_DATAGRAM) len = NET_MAX_DATAGRAM;
+
+        memset(&out[n].addr, 0, sizeof(out[n].addr));
+        memcpy(&out[n].addr, buf + sizeof(*o), o->namelen < sizeof(out[n].addr) ? o->namelen : sizeof(out[n].addr));
+        out[n].head = NULL;
+        out[n].head_len = 0;
+        out[n].data = payload;
+        out[n].len = len;
+        payload[len] = 0;
+        u->lent[u->lent_count++] = bid;
+        n++;
+    }
+    if (n == 0) t->stats->rx_empty_polls++;
+    t->stats->rx_packets += n;
+    return n;
+}
+
+static int uring_send_batch(NetTransport *t, const NetDatagram *dgrams, int n) {
+    UringTransport *u = (UringTransport *)t;
+    struct msghdr msgs[URING_SQ_ENTRIES];
+    struct iovec iov[URING_SQ_ENTRIES][2];
+    int sent = 0;
+
+    while (sent < n) {
+        int queued = 0;
+        while (sent + queued < n && queued < URING_SQ_ENTRIES - 1) { // leave room for a re-arm
+            const NetDatagram *d = &dgrams[sent + queued];
+            struct io_uring_sqe *sqe = get_sqe(u);
+            if (!sqe) break;
+            int k = 0;
+            if (d->head_len > 0) {
+                iov[queued][k].iov_base = (void *)d->head;
+                iov[queued][k++].iov_len = d->head_len;
+            }
+            iov[queued][k].iov_base = d->data;
+            iov[queued][k++].iov_len = d->len;
+            memset(&msgs[queued], 0, sizeof(msgs[queued]));
+            msgs[queued].msg_name = (void *)&d->addr;
+            msgs[queued].msg_namelen = sizeof(d->addr);
+            msgs[queued].msg_iov = iov[queued];
+            msgs[queued].msg_iovlen = k;
+
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = u->sockfd;
+            sqe->addr = (unsigned long)&msgs[queued];
+            sqe->len = 1;
+            sqe->msg_flags = MSG_DONTWAIT;
+            sqe->user_data = URING_TAG_SEND;
+            queued++;
+        }
+        if (queued == 0) break;
+
+        // One enter submits the lot; wait for every send so msgs[] can be reused
+        int done = 0;
+        while (done < queued) {
+            int r = uring_enter(u->ring_fd, u->sq_pending, queued - done, IORING_ENTER_GETEVENTS);
+            t->stats->tx_syscalls++;
+            if (r < 0 && errno != EINTR) return sent;
+            if (r > 0) u->sq_pending -= (unsigned)r < u->sq_pending ? (unsigned)r : u->sq_pending;
+            done += reap(u);
+        }
+        sent += queued;
+        t->stats->tx_packets += queued;
+    }
+    return sent;
+}
+
+static bool uring_wait(NetTransport *t, int timeout_ms) {
+    UringTransport *u = (UringTransport *)t;
+    if (u->held_count > 0) return true;
+    if (*u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) return true;
+    if (!u->recv_armed) return true; // let recv_batch re-arm
+    struct pollfd pfd[2] = { { u->ring_fd, POLLIN, 0 }, { t->wake_fd, POLLIN, 0 } };
+    return poll(pfd, t->wake_fd >= 0 ? 2 : 1, timeout_ms) > 0;
+}
+
+static void uring_destroy(NetTransport *t) {
+    UringTransport *u = (UringTransport *)t;
+    if (u->ring_fd >= 0) close(u->ring_fd);
+    if (u->sqes) munmap(u->sqes, u->sqes_size);
+    if (u->cq_ptr && u->cq_ptr != u->sq_ptr) munmap(u->cq_ptr, u->cq_size);
+    if (u->sq_ptr) munmap(u->sq_ptr, u->sq_size);
+    if (u->buf_ring) munmap(u->buf_ring, u->buf_ring_size);
+    free(u->bufs);
+    free(u);
+}
+
+// --- Setup ---
+static bool map_rings(UringTransport *u, struct io_uring_params *p) {
+    u->sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    u->cq_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p->features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && u->cq_size > u->sq_size) u->sq_size = u->cq_size;
+
+    u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED) { u->sq_ptr = NULL; return false; }
+    if (single) {
+        u->cq_ptr = u->sq_ptr;
+    } else {
+        u->cq_ptr = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_CQ_RING);
+        if (u->cq_ptr == MAP_FAILED) { u->cq_ptr = NULL; return false; }
+    }
+    u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) { u->sqes = NULL; return false; }
+
+    char *sq = u->sq_ptr, *cq = u->cq_ptr;
+    u->sq_head = (unsigned *)(sq + p->sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p->sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p->sq_off.array);
+    u->cq_head = (unsigned *)(cq + p->cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p->cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    return true;
+}
+
+static bool register_buffers(UringTransport *u) {
+    u->buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    u->buf_ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->buf_ring == MAP_FAILED) { u->buf_ring = NULL; return false; }
+    u->bufs = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (!u->bufs) return false;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)u->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BGID;
+    if (uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+
+    for (int i = 0; i < URING_BUF_COUNT; i++) recycle_buffer(u, (unsigned short)i);
+    publish_buffers(u);
+    return true;
+}
+
+NetTransport *net_uring_transport_create(int sockfd, NetIoStats *stats) {
+    UringTransport *u = calloc(1, sizeof(UringTransport));
+    if (!u) return NULL;
+    u->sockfd = sockfd;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_CQ_ENTRIES;
+    u->ring_fd = uring_setup(URING_SQ_ENTRIES, &p);
+    if (u->ring_fd < 0 || !map_rings(u, &p) || !register_buffers(u)) {
+        uring_destroy(&u->base);
+        return NULL;
+    }
+
+    // Multishot recvmsg only reads the name/control sizes from this
+    u->recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    u->recv_msg.msg_controllen = 0;
+    arm_recv(u);
+    if (uring_enter(u->ring_fd, u->sq_pending, 0, 0) < 0) {
+        uring_destroy(&u->base);
+        return NULL;
+    }
+    u->sq_pending = 0;
+
+    u->base.name = "io_uring";
+    u->base.recv_batch = uring_recv_batch;
+    u->base.send_batch = uring_send_batch;
+    u->base.wait = uring_wait;
+    u->base.destroy = uring_destroy;
+    u->base.stats = stats;
+    u->base.wake_fd = -1;
+    return &u->base;
+}
+#endif
@@ -1,8 +1,18 @@
+#ifndef _WIN32
+#define _GNU_SOURCE // sendmmsg
+#endif
 #include "network.h"
+#include "net_transport.h"
+#include "timer_wheel.h"
+#include "journal.h"
+#include "metrics.h"
+#include "profile.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <time.h>
 
 #ifdef _WIN32
@@ -10,63 +20,501 @@
     #include <ws2tcpip.h>
     #pragma comment(lib, "ws2_32.lib")
     typedef int socklen_t;
+    #define strtok_r strtok_s
 #else
     #include <unistd.h>
     #include <arpa/inet.h>
     #include <sys/socket.h>
-    #include <sys/time.h>
     #include <fcntl.h>
+    #include <sys/uio.h>
+    #include <poll.h>
+    #include <pthread.h>
     #define INVALID_SOCKET -1
     #define SOCKET_ERROR -1
     #define closesocket close
 #endif
 
 // --- Internal State ---
-static int sockfd = -1;
-static struct sockaddr_in peer_addr;
-static bool peer_known = false;
-static int local_seq = 0;
-static int remote_seq = 0;
+// Everything a socket needs lives in a NetWorker. Each thread drives one
+// worker (see net_worker_select()), so workers never share hot-path state.
 
 // Reliability Buffer
+// Messages are staged here and go out on the next flush, so several frames
+// (and a pending ACK) can share one datagram. Slots are kept in seq order.
+// Payloads are sized to the message and counted against the session budget.
 typedef struct {
     bool active;
-    char payload[4096];
+    char *payload;
+    int len;
     int seq;
     int retries;
-    long long last_sent;
+    long long last_sent; // 0 = staged, not on the wire yet
+    long long first_sent_us; // for the ACK RTT sample
+    bool due;            // retry timer fired: resend on the next flush
+    TimerNode retry;
 } PendingPacket;
 
-static PendingPacket outgoing = {0};
+// One lane of a session: its own sequence space, send queue and ACK, so a
+// backlog or loss on one lane never holds up another
+typedef struct {
+    int local_seq;
+    int remote_seq;
+    PendingPacket outgoing[MAX_PENDING];
+    int out_head;  // oldest unacknowledged slot
+    int out_count;
+    bool ack_pending;
+} LaneState;
+
+// Per-lane wire names: the channel: header on frames, and the ACK header key.
+// The game lane uses the original keys (no channel line) so old peers still
+// understand it.
+static const char *LANE_NAMES[NET_LANE_COUNT] = { "game", "chat", "bulk" };
+static const char *LANE_ACK_KEYS[NET_LANE_COUNT] = { "ack_number", "ack_chat", "ack_bulk" };
+
+// One remote endpoint: keyed by source address + session_id, it owns its
+// lanes, delayed ACK and battle state.
+struct NetSession {
+    struct sockaddr_in addr;
+    unsigned int session_id;
+
+    LaneState lanes[NET_LANE_COUNT];
+
+    // Delayed ACK: cumulative per lane, rides on the next data datagram if
+    // one goes out before ack_due, otherwise sent on its own
+    long long ack_due;
+    TimerNode ack_timer;
+
+    long long last_heard;
+    long long last_sent;
+    TimerNode keepalive_timer; // quiet for NET_KEEPALIVE_MS: send a bare ACK
+    TimerNode evict_timer;     // idle timeout, or closing and drained
+    TimerNode turn_timer;      // see net_session_arm_turn_timer()
+    bool closing;        // evict once the send queue drains
+    size_t mem_bytes;    // struct + queued payloads
+    NetSession *next_dirty;
+    bool in_dirty;
+
+    // Spectator fan-out: a battle keeps its subscribers, a spectator points
+    // back at the battle it watches
+    NetSession **spectators;
+    int spectator_count;
+    int spectator_cap;
+    NetSession *watching;
+    bool wants_primary;  // host mode: subscribed before the opponent arrived
+    unsigned int event_seq;
+    char *bcast_buf;     // events encoded once, sent to every spectator
+    int bcast_len;
+
+    BattleContext battle;
+    void *user;          // see net_session_set_user()
+
+    // Sharded servers (see net_hand_over_spectator())
+    NetWorker *forward_to;      // stub: the peer's session lives on that worker now
+    NetWorker *hand_over_to;    // moves there after the current datagram
+    char *hand_over_frame;      // the request it replays there
+    NetSession *next_hand_over;
+    bool handed_over;           // came from another worker; never moves twice
+    bool registered;            // listed in the battle registry
+};
+
+// A spectator session passed to another worker (with the request it replays
+// there), or a datagram the kernel gave to the wrong worker
+typedef struct InboxItem {
+    struct InboxItem *next;
+    NetSession *session;
+    struct sockaddr_in addr;
+    int len;
+    char data[];         // NUL-terminated
+} InboxItem;
+
+// Send side: datagrams built during a flush go out in one sendmmsg
+typedef struct {
+    struct sockaddr_in addr;
+    int len;
+    char data[NET_MAX_DATAGRAM];
+} TxSlot;
+
+struct NetWorker {
+    int sockfd;
+
+    // Session table: open addressing, linear probing, power-of-two capacity
+    NetSession **session_table;
+    unsigned int table_mask;
+    int session_count;
+    int max_sessions;
+    bool accept_sessions; // host/server: unknown senders open a session
+    bool server_mode;
+    size_t total_mem_bytes;
+
+    NetSession *primary;    // the opponent in host/join mode
+    NetSession *active;     // where net_send_game_message() goes
+    NetSession *dirty_head; // sessions with something to flush
+    unsigned int my_session_id;
+
+    // Every deadline this worker owns: retransmits, delayed ACKs, keepalives,
+    // evictions, turn timeouts and whatever the caller arms
+    TimerWheel timers;
+    NetTurnTimeoutHandler on_turn_timeout;
+    void *turn_timeout_arg;
+
+    NetTransport *transport;
+
+    // Receive side: the transport hands over up to NET_IO_BATCH datagrams at
+    // a time; a datagram may hold several frames, handed out one per call
+    NetDatagram rx_batch[NET_IO_BATCH];
+    int rx_count;
+    int rx_index;
+    char *rx_next;
+    NetSession *rx_session;
+
+    TxSlot tx_batch[NET_IO_BATCH];
+    int tx_count;
+
+    NetIoStats io_stats;
+
+    // Sharded servers: what other workers pass to this one. The pipe wakes
+    // net_wait(); wake_pending keeps it to one byte however much is queued.
+    bool shares_battles;
+    InboxItem *inbox_head;
+    InboxItem *inbox_tail;
+    InboxItem *rx_item;         // forwarded datagram being read
+    NetSession *hand_over_head; // spectators to pass on once their datagram is done
+    int wake_pipe[2];
+    int wake_pending;
+#ifndef _WIN32
+    pthread_mutex_t inbox_lock;
+#endif
+};
+
+#if defined(_MSC_VER)
+    #define NET_THREAD_LOCAL __declspec(thread)
+#else
+    #define NET_THREAD_LOCAL __thread
+#endif
+
+static NET_THREAD_LOCAL NetWorker *W = NULL;
 
 // --- Time Helper ---
+// Monotonic: deadlines must not jump when someone sets the wall clock
 long long current_time_ms() {
 #ifdef _WIN32
     return GetTickCount64();
 #else
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (tv.tv_sec * 1000LL) + (tv.tv_usec / 1000);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000LL) + (ts.tv_nsec / 1000000);
 #endif
 }
 
+// The worker's clock: real time, unless its transport keeps its own (the
+// in-process loopback runs on a virtual clock)
+static long long now_ms(void) {
+    return W->transport->now ? W->transport->now(W->transport) : current_time_ms();
+}
+
+// The same clock in microseconds, for metrics
+static long long now_us(void) {
+    return W->transport->now ? W->transport->now(W->transport) * 1000 : metrics_now_us();
+}
+
+static void session_timers_init(NetSession *s);
+static void session_timers_cancel(NetSession *s);
+
+// --- Session Table ---
+static unsigned int session_hash(const struct sockaddr_in *addr, unsigned int id) {
+    unsigned int h = (unsigned int)addr->sin_addr.s_addr * 0x9E3779B1u;
+    h ^= ((unsigned int)addr->sin_port << 16) ^ (id * 0x85EBCA6Bu);
+    h ^= h >> 15;
+    return h;
+}
+
+static bool session_matches(const NetSession *s, const struct sockaddr_in *addr, unsigned int id) {
+    return s->session_id == id &&
+           s->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+           s->addr.sin_port == addr->sin_port;
+}
+
+static bool session_table_init(int capacity) {
+    unsigned int size = 16;
+    while (size < (unsigned int)capacity * 2) size <<= 1;
+    W->session_table = calloc(size, sizeof(NetSession *));
+    if (!W->session_table) return false;
+    W->table_mask = size - 1;
+    W->max_sessions = capacity;
+    W->total_mem_bytes = size * sizeof(NetSession *);
+    return true;
+}
+
+static NetSession *session_find(const struct sockaddr_in *addr, unsigned int id) {
+    if (!W->session_table) return NULL;
+    unsigned int i = session_hash(addr, id) & W->table_mask;
+    while (W->session_table[i]) {
+        if (session_matches(W->session_table[i], addr, id)) return W->session_table[i];
+        i = (i + 1) & W->table_mask;
+    }
+    return NULL;
+}
+
+// Files a session in the table and counts it against the worker
+static void session_link(NetSession *s) {
+    unsigned int i = session_hash(&s->addr, s->session_id) & W->table_mask;
+    while (W->session_table[i]) i = (i + 1) & W->table_mask;
+    W->session_table[i] = s;
+    W->session_count++;
+    W->total_mem_bytes += s->mem_bytes;
+}
+
+static NetSession *session_create(const struct sockaddr_in *addr, unsigned int id) {
+    if (!W->session_table || W->session_count >= W->max_sessions) return NULL;
+    NetSession *s = calloc(1, sizeof(NetSession));
+    if (!s) return NULL;
+    s->addr = *addr;
+    s->session_id = id;
+    s->last_heard = s->last_sent = now_ms();
+    s->mem_bytes = sizeof(NetSession);
+    session_timers_init(s);
+    session_link(s);
+    return s;
+}
+
+static void session_free_payloads(NetSession *s) {
+    for (int l = 0; l < NET_LANE_COUNT; l++) {
+        for (int i = 0; i < MAX_PENDING; i++) {
+            PendingPacket *pkt = &s->lanes[l].outgoing[i];
+            if (pkt->payload) {
+                free(pkt->payload);
+                pkt->payload = NULL;
+            }
+        }
+    }
+}
+
+static bool session_has_queued(const NetSession *s) {
+    for (int l = 0; l < NET_LANE_COUNT; l++)
+        if (s->lanes[l].out_count > 0) return true;
+    return false;
+}
+
+// Takes a session out of the table and the worker's totals
+static void session_unlink(NetSession *s) {
+    unsigned int i = session_hash(&s->addr, s->session_id) & W->table_mask;
+    while (W->session_table[i] != s) i = (i + 1) & W->table_mask;
+
+    // Backward-shift delete keeps probe chains intact without tombstones
+    W->session_table[i] = NULL;
+    unsigned int j = i;
+    for (;;) {
+        j = (j + 1) & W->table_mask;
+        if (!W->session_table[j]) break;
+        unsigned int k = session_hash(&W->session_table[j]->addr, W->session_table[j]->session_id) & W->table_mask;
+        bool movable = (j > i) ? (k <= i || k > j) : (k <= i && k > j);
+        if (movable) {
+            W->session_table[i] = W->session_table[j];
+            W->session_table[j] = NULL;
+            i = j;
+        }
+    }
+
+    if (s == W->primary) W->primary = NULL;
+    if (s == W->active) W->active = NULL;
+    W->total_mem_bytes -= s->mem_bytes;
+    W->session_count--;
+}
+
+// Frees what the session owns; it is out of every table and list by now
+static void session_release(NetSession *s) {
+    session_free_payloads(s);
+    journal_close(s->battle.journal);
+    free(s->spectators);
+    free(s->bcast_buf);
+    free(s->hand_over_frame);
+    free(s);
+}
+
+static void registry_remove(NetSession *s);
+
+static void session_destroy(NetSession *s) {
+    session_unlink(s);
+    if (s->registered) registry_remove(s);
+    if (s->hand_over_to) {
+        NetSession **p = &W->hand_over_head;
+        while (*p != s) p = &(*p)->next_hand_over;
+        *p = s->next_hand_over;
+    }
+    if (s->watching) net_unwatch_battle(s);
+    for (int k = 0; k < s->spectator_count; k++) {
+        s->spectators[k]->watching = NULL;
+        net_session_close(s->spectators[k]);
+    }
+    session_timers_cancel(s);
+    session_release(s);
+}
+
+static void mark_dirty(NetSession *s) {
+    if (s->in_dirty) return;
+    s->in_dirty = true;
+    s->next_dirty = W->dirty_head;
+    W->dirty_head = s;
+}
+
+// --- Session Timers ---
+// Each callback runs from timer_wheel_advance() at the top of
+// net_process_updates(), so it never races a flush or a half-read datagram
+// of its own worker.
+
+static void send_bare_ack(NetSession *s);
+
+static void on_ack_due(TimerNode *t, void *arg) {
+    (void)t;
+    mark_dirty((NetSession *)arg);
+}
+
+static void on_keepalive(TimerNode *t, void *arg) {
+    NetSession *s = arg;
+    long long quiet_until = s->last_sent + NET_KEEPALIVE_MS;
+    if (W->timers.now >= quiet_until) {
+        send_bare_ack(s);
+        quiet_until = W->timers.now + NET_KEEPALIVE_MS;
+    }
+    timer_arm(&W->timers, t, quiet_until);
+}
+
+// Drops a session once it has gone quiet, or once it is closing and
+// everything it sent has been acknowledged
+static void on_evict(TimerNode *t, void *arg) {
+    NetSession *s = arg;
+    long long now = W->timers.now;
+    bool done = s->closing && !session_has_queued(s);
+    // Only the opponent is kept through a quiet spell. Spectators ACK the
+    // feed and send keepalives, so one silent for NET_SESSION_IDLE_MS is gone.
+    // A closing session whose peer went quiet would otherwise resend forever.
+    bool exempt = s == W->primary;
+    bool idle = now - s->last_heard > NET_SESSION_IDLE_MS && (!exempt || s->closing);
+    if (!done && !idle) {
+        long long next = s->closing ? now + RETRY_DELAY_MS : s->last_heard + NET_SESSION_IDLE_MS + 1;
+        timer_arm(&W->timers, t, exempt && !s->closing ? now + NET_SESSION_IDLE_MS : next);
+        return;
+    }
+    if (s->in_dirty || s == W->rx_session) {
+        // Still linked into the flush list or mid-datagram; try again shortly
+        timer_arm(&W->timers, t, now + NET_EVICT_RETRY_MS);
+        return;
+    }
+    if (W->server_mode) LOG_INFO("[NET] Session %u closed (%s)\n", s->session_id, done ? "finished" : "idle");
+    session_destroy(s);
+}
+
+static void on_turn_timeout(TimerNode *t, void *arg) {
+    (void)t;
+    if (W->on_turn_timeout) W->on_turn_timeout((NetSession *)arg, W->turn_timeout_arg);
+}
+
+static void on_retry_due(TimerNode *t, void *arg) {
+    PendingPacket *pkt = (PendingPacket *)((char *)t - offsetof(PendingPacket, retry));
+    pkt->due = true;
+    mark_dirty((NetSession *)arg);
+}
+
+static void session_timers_init(NetSession *s) {
+    for (int l = 0; l < NET_LANE_COUNT; l++)
+        for (int i = 0; i < MAX_PENDING; i++)
+            timer_init(&s->lanes[l].outgoing[i].retry, on_retry_due, s);
+    timer_init(&s->ack_timer, on_ack_due, s);
+    timer_init(&s->keepalive_timer, on_keepalive, s);
+    timer_init(&s->evict_timer, on_evict, s);
+    timer_init(&s->turn_timer, on_turn_timeout, s);
+    timer_arm(&W->timers, &s->keepalive_timer, s->last_sent + NET_KEEPALIVE_MS);
+    timer_arm(&W->timers, &s->evict_timer, s->last_heard + NET_SESSION_IDLE_MS + 1);
+}
+
+static void session_timers_cancel(NetSession *s) {
+    for (int l = 0; l < NET_LANE_COUNT; l++)
+        for (int i = 0; i < MAX_PENDING; i++)
+            timer_cancel(&W->timers, &s->lanes[l].outgoing[i].retry);
+    timer_cancel(&W->timers, &s->ack_timer);
+    timer_cancel(&W->timers, &s->keepalive_timer);
+    timer_cancel(&W->timers, &s->evict_timer);
+    timer_cancel(&W->timers, &s->turn_timer);
+}
+
+static void run_timers(void) {
+    timer_wheel_advance(&W->timers, now_ms());
+}
+
 // --- Initialization ---
 bool net_init(int port) {
+    return net_init_server(port, NET_DEFAULT_MAX_SESSIONS, false);
+}
+
+bool net_init_server(int port, int capacity, bool multi_battle) {
+    NetWorker *w = net_worker_create(port, capacity, multi_battle, false);
+    if (!w) return false;
+    net_worker_select(w);
+    LOG_INFO("[NET] Listening on port %d\n", port);
+    return true;
+}
+
+void net_cleanup() {
+    if (!W) return;
+    net_worker_destroy(W);
+}
+
+// Finishes a worker once its transport is there; frees everything on failure
+static NetWorker *worker_attach(NetWorker *w, NetTransport *t, int capacity) {
+    w->transport = t;
+    NetWorker *prev = W;
+    W = w; // session_table_init() and the clock work on the current worker
+    bool ok = w->transport && session_table_init(capacity);
+    if (ok) timer_wheel_init(&w->timers, now_ms());
+    W = prev;
+    if (!ok) {
+        if (w->transport) w->transport->destroy(w->transport);
+        if (w->sockfd >= 0) closesocket(w->sockfd);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+static NetWorker *worker_alloc(bool multi_battle) {
 #ifdef _WIN32
     WSADATA wsa;
     WSAStartup(MAKEWORD(2, 2), &wsa);
 #endif
+    NetWorker *w = calloc(1, sizeof(NetWorker));
+    if (!w) return NULL;
+    w->sockfd = -1;
+    w->accept_sessions = true;
+    w->server_mode = multi_battle;
+    return w;
+}
+
+NetWorker *net_worker_create(int port, int capacity, bool multi_battle, bool reuse_port) {
+    NetWorker *w = worker_alloc(multi_battle);
+    if (!w) return NULL;
 
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) return false;
+    w->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (w->sockfd < 0) {
+        free(w);
+        return NULL;
+    }
 
     // Non-blocking mode
 #ifdef _WIN32
     u_long mode = 1;
-    ioctlsocket(sockfd, FIONBIO, &mode);
+    ioctlsocket(w->sockfd, FIONBIO, &mode);
 #else
-    int flags = fcntl(sockfd, F_GETFL, 0);
-    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+    int flags = fcntl(w->sockfd, F_GETFL, 0);
+    fcntl(w->sockfd, F_SETFL, flags | O_NONBLOCK);
+#endif
+
+#ifdef SO_REUSEPORT
+    // Several workers bind the same port; the kernel hashes each peer's
+    // 4-tuple to one socket, so a session always lands on the same worker
+    if (reuse_port) {
+        int one = 1;
+        setsockopt(w->sockfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    }
 #endif
 
     struct sockaddr_in my_addr = {0};
@@ -74,44 +522,488 @@ bool net_init(int port) {
     my_addr.sin_addr.s_addr = INADDR_ANY;
     my_addr.sin_port = htons(port);
 
-    if (bind(sockfd, (struct sockaddr*)&my_addr, sizeof(my_addr)) < 0) {
+    if (bind(w->sockfd, (struct sockaddr*)&my_addr, sizeof(my_addr)) < 0) {
         perror("Bind failed");
-        return false;
+        closesocket(w->sockfd);
+        free(w);
+        return NULL;
     }
-    printf("[NET] Listening on port %d\n", port);
-    return true;
+
+    NetTransport *t = NULL;
+#ifdef NET_USE_IO_URING
+    t = net_uring_transport_create(w->sockfd, &w->io_stats);
+    if (!t) LOG_WARN("[NET] io_uring unavailable, using sockets\n");
+#endif
+    if (!t) t = net_socket_transport_create(w->sockfd, &w->io_stats);
+    return worker_attach(w, t, capacity);
 }
 
-void net_cleanup() {
-    if (sockfd >= 0) closesocket(sockfd);
+NetWorker *net_worker_create_on(NetTransport *t, int capacity, bool multi_battle) {
+    NetWorker *w = worker_alloc(multi_battle);
+    if (!w) {
+        t->destroy(t);
+        return NULL;
+    }
+    t->stats = &w->io_stats;
+    return worker_attach(w, t, capacity);
+}
+
+void net_worker_destroy(NetWorker *w) {
+    NetWorker *prev = W;
+    W = w;
+    net_flush();
+    w->transport->destroy(w->transport);
+    if (w->sockfd >= 0) closesocket(w->sockfd);
+    if (w->session_table) {
+        for (unsigned int i = 0; i <= w->table_mask; i++) {
+            NetSession *s = w->session_table[i];
+            if (!s) continue;
+            if (s->registered) registry_remove(s);
+            session_release(s);
+        }
+        free(w->session_table);
+    }
+    while (w->inbox_head) {
+        InboxItem *item = w->inbox_head;
+        w->inbox_head = item->next;
+        if (item->session) session_release(item->session);
+        free(item);
+    }
+    free(w->rx_item);
+#ifndef _WIN32
+    if (w->shares_battles) {
+        close(w->wake_pipe[0]);
+        close(w->wake_pipe[1]);
+        pthread_mutex_destroy(&w->inbox_lock);
+    }
+#endif
+    free(w);
+    W = (prev == w) ? NULL : prev;
 #ifdef _WIN32
     WSACleanup();
 #endif
 }
 
+void net_worker_select(NetWorker *w) { W = w; }
+NetWorker *net_current_worker(void) { return W; }
+
+static struct sockaddr_in peer_address(const char *ip, int port) {
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &addr.sin_addr);
+    return addr;
+}
+
+static unsigned int random_session_id(void) {
+    return ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+}
+
 void net_set_peer(const char *ip, int port) {
-    peer_addr.sin_family = AF_INET;
-    peer_addr.sin_port = htons(port);
-    inet_pton(AF_INET, ip, &peer_addr.sin_addr);
-    peer_known = true;
+    struct sockaddr_in addr = peer_address(ip, port);
+
+    // Joiners and spectators name their session so a host can tell
+    // several battles behind one address apart
+    while (W->my_session_id == 0) W->my_session_id = random_session_id();
+    W->primary = session_find(&addr, W->my_session_id);
+    if (!W->primary) W->primary = session_create(&addr, W->my_session_id);
+    W->active = W->primary;
+    W->accept_sessions = false;
+}
+
+NetSession *net_connect(const char *ip, int port) {
+    struct sockaddr_in addr = peer_address(ip, port);
+    unsigned int id = 0;
+    while (id == 0 || session_find(&addr, id)) id = random_session_id();
+    W->accept_sessions = false;
+    return session_create(&addr, id);
+}
+
+bool net_is_peer_set() { return W->primary != NULL; }
+int net_get_next_sequence() { return W && W->active ? W->active->lanes[NET_LANE_GAME].local_seq + 1 : 1; }
+
+const char* net_get_peer_ip() {
+    NetSession *s = W->active ? W->active : W->primary;
+    return s ? inet_ntoa(s->addr.sin_addr) : "";
+}
+
+// --- Session Access ---
+NetSession *net_active_session(void) { return W->active; }
+NetSession *net_primary_session(void) { return W->primary; }
+void net_select_session(NetSession *s) { W->active = s; }
+unsigned int net_session_id(const NetSession *s) { return s->session_id; }
+BattleContext *net_session_battle(NetSession *s) { return &s->battle; }
+void net_session_set_user(NetSession *s, void *user) { s->user = user; }
+void *net_session_user(const NetSession *s) { return s->user; }
+size_t net_session_memory_bytes(const NetSession *s) { return s->mem_bytes; }
+void net_session_charge_memory(NetSession *s, long bytes) {
+    s->mem_bytes += bytes;
+    W->total_mem_bytes += bytes;
+}
+void net_session_close(NetSession *s) {
+    s->closing = true;
+    timer_arm(&W->timers, &s->evict_timer, now_ms());
+}
+int net_session_count(void) { return W->session_count; }
+int net_spectator_count(const NetSession *s) { return s->spectator_count; }
+NetSession *net_watched_battle(const NetSession *s) { return s->watching; }
+unsigned int net_event_seq(const NetSession *s) { return s->event_seq; }
+
+NetSession *net_find_session_by_id(unsigned int id) {
+    for (unsigned int i = 0; i <= W->table_mask; i++) {
+        NetSession *s = W->session_table[i];
+        if (s && s->session_id == id && !s->forward_to) return s;
+    }
+    return NULL;
+}
+size_t net_memory_bytes(void) { return W->total_mem_bytes; }
+
+// --- Timers ---
+void net_timer_arm(TimerNode *t, int delay_ms) {
+    timer_arm(&W->timers, t, now_ms() + delay_ms);
+}
+
+void net_timer_cancel(TimerNode *t) {
+    timer_cancel(&W->timers, t);
+}
+
+void net_set_turn_timeout_handler(NetTurnTimeoutHandler handler, void *arg) {
+    W->on_turn_timeout = handler;
+    W->turn_timeout_arg = arg;
+}
+
+void net_session_arm_turn_timer(NetSession *s, int timeout_ms) {
+    net_timer_arm(&s->turn_timer, timeout_ms);
+}
+
+void net_session_cancel_turn_timer(NetSession *s) {
+    timer_cancel(&W->timers, &s->turn_timer);
+}
+
+bool net_session_turn_timer_armed(const NetSession *s) {
+    return timer_pending(&s->turn_timer);
+}
+
+// --- Socket Transport ---
+typedef struct {
+    NetTransport base;
+    int sockfd;
+    char bufs[NET_IO_BATCH][NET_MAX_DATAGRAM + 1];
+} SocketTransport;
+
+static int socket_recv_batch(NetTransport *t, NetDatagram *out, int max) {
+    SocketTransport *st = (SocketTransport *)t;
+    if (max > NET_IO_BATCH) max = NET_IO_BATCH;
+#if defined(__linux__)
+    struct mmsghdr msgs[NET_IO_BATCH];
+    struct iovec iov[NET_IO_BATCH];
+    for (int i = 0; i < max; i++) {
+        iov[i].iov_base = st->bufs[i];
+        iov[i].iov_len = NET_MAX_DATAGRAM;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = &out[i].addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(out[i].addr);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int r = recvmmsg(st->sockfd, msgs, max, MSG_DONTWAIT, NULL);
+    if (r <= 0) {
+        t->stats->rx_empty_polls++;
+        return 0;
+    }
+    t->stats->rx_syscalls++;
+    for (int i = 0; i < r; i++) {
+        out[i].data = st->bufs[i];
+        out[i].len = (int)msgs[i].msg_len;
+        out[i].data[out[i].len] = 0;
+    }
+#else
+    socklen_t slen = sizeof(out[0].addr);
+    int r = recvfrom(st->sockfd, st->bufs[0], NET_MAX_DATAGRAM, 0, (struct sockaddr*)&out[0].addr, &slen);
+    if (r <= 0) {
+        t->stats->rx_empty_polls++;
+        return 0;
+    }
+    t->stats->rx_syscalls++;
+    out[0].data = st->bufs[0];
+    out[0].len = r;
+    out[0].data[r] = 0;
+    r = 1;
+#endif
+    t->stats->rx_packets += r;
+    return r;
+}
+
+static int socket_send_batch(NetTransport *t, const NetDatagram *dgrams, int n) {
+    SocketTransport *st = (SocketTransport *)t;
+    int sent = 0;
+#if defined(__linux__)
+    struct mmsghdr msgs[NET_IO_BATCH];
+    struct iovec iov[NET_IO_BATCH][2];
+    while (sent < n) {
+        int chunk = n - sent;
+        if (chunk > NET_IO_BATCH) chunk = NET_IO_BATCH;
+        for (int i = 0; i < chunk; i++) {
+            const NetDatagram *d = &dgrams[sent + i];
+            int k = 0;
+            if (d->head_len > 0) {
+                iov[i][k].iov_base = (void *)d->head;
+                iov[i][k++].iov_len = d->head_len;
+            }
+            iov[i][k].iov_base = d->data;
+            iov[i][k++].iov_len = d->len;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = (void *)&d->addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(d->addr);
+            msgs[i].msg_hdr.msg_iov = iov[i];
+            msgs[i].msg_hdr.msg_iovlen = k;
+        }
+        int r = sendmmsg(st->sockfd, msgs, chunk, 0);
+        t->stats->tx_syscalls++;
+        if (r <= 0) break; // socket buffer full: the retry timer covers it
+        sent += r;
+        t->stats->tx_packets += r;
+    }
+#else
+    char dgram[NET_MAX_DATAGRAM + 64];
+    for (; sent < n; sent++) {
+        const NetDatagram *d = &dgrams[sent];
+        const char *data = d->data;
+        int len = d->len;
+        if (d->head_len > 0) {
+            memcpy(dgram, d->head, d->head_len);
+            memcpy(dgram + d->head_len, d->data, d->len);
+            data = dgram;
+            len += d->head_len;
+        }
+        sendto(st->sockfd, data, len, 0, (const struct sockaddr*)&d->addr, sizeof(d->addr));
+        t->stats->tx_syscalls++;
+        t->stats->tx_packets++;
+    }
+#endif
+    return sent;
+}
+
+static bool socket_wait(NetTransport *t, int timeout_ms) {
+    SocketTransport *st = (SocketTransport *)t;
+#ifdef _WIN32
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(st->sockfd, &fds);
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    return select(0, &fds, NULL, NULL, timeout_ms < 0 ? NULL : &tv) > 0;
+#else
+    struct pollfd pfd[2] = { { st->sockfd, POLLIN, 0 }, { t->wake_fd, POLLIN, 0 } };
+    return poll(pfd, t->wake_fd >= 0 ? 2 : 1, timeout_ms) > 0;
+#endif
+}
+
+static void socket_destroy(NetTransport *t) {
+    free(t);
 }
 
-bool net_is_peer_set() { return peer_known; }
-int net_get_next_sequence() { return local_seq + 1; }
+NetTransport *net_socket_transport_create(int sockfd, NetIoStats *stats) {
+    SocketTransport *st = calloc(1, sizeof(SocketTransport));
+    if (!st) return NULL;
+    st->base.name = "socket";
+    st->base.recv_batch = socket_recv_batch;
+    st->base.send_batch = socket_send_batch;
+    st->base.wait = socket_wait;
+    st->base.destroy = socket_destroy;
+    st->base.stats = stats;
+    st->base.wake_fd = -1;
+    st->sockfd = sockfd;
+    return &st->base;
+}
+
+// --- Batched I/O ---
+// Datagrams built during a flush go out in one transport call
+static void count_datagrams(MetricCounter packets, MetricCounter bytes, const NetDatagram *d, int n) {
+    if (n <= 0) return;
+    unsigned long long total = 0;
+    for (int i = 0; i < n; i++) total += (unsigned long long)(d[i].head_len + d[i].len);
+    metrics_add(packets, (unsigned long long)n);
+    metrics_add(bytes, total);
+}
+
+static void tx_submit(void) {
+    if (W->tx_count == 0) return;
+    NetDatagram out[NET_IO_BATCH];
+    for (int i = 0; i < W->tx_count; i++) {
+        out[i].addr = W->tx_batch[i].addr;
+        out[i].head = NULL;
+        out[i].head_len = 0;
+        out[i].data = W->tx_batch[i].data;
+        out[i].len = W->tx_batch[i].len;
+    }
+    W->transport->send_batch(W->transport, out, W->tx_count);
+    count_datagrams(METRIC_DATAGRAMS_SENT, METRIC_BYTES_SENT, out, W->tx_count);
+    W->tx_count = 0;
+}
+
+// Pulls up to NET_IO_BATCH datagrams off the transport in one call
+static bool rx_fill(void) {
+    W->rx_index = 0;
+    W->rx_count = W->transport->recv_batch(W->transport, W->rx_batch, NET_IO_BATCH);
+    count_datagrams(METRIC_DATAGRAMS_RECEIVED, METRIC_BYTES_RECEIVED, W->rx_batch, W->rx_count);
+    return W->rx_count > 0;
+}
+
+NetIoStats net_get_io_stats(void) { return W->io_stats; }
+long long net_next_deadline(void) { return timer_wheel_next_deadline(&W->timers); }
+const char *net_transport_name(void) { return W->transport->name; }
+
+bool net_wait(int timeout_ms) {
+    if (W->rx_index < W->rx_count || W->rx_next) return true;
+    if (W->shares_battles && __atomic_load_n(&W->inbox_head, __ATOMIC_ACQUIRE)) return true;
+    // Anything staged since the last poll goes out before we block
+    if (W->dirty_head) net_flush();
+    // Sleep no later than the next deadline; net_process_updates() runs it
+    long long deadline = timer_wheel_next_deadline(&W->timers);
+    if (deadline >= 0) {
+        long long until = deadline - now_ms();
+        if (until < 0) until = 0;
+        if (timeout_ms < 0 || until < timeout_ms) timeout_ms = (int)until;
+    }
+    return W->transport->wait(W->transport, timeout_ms);
+}
+
+void net_set_wake_fd(int fd) {
+    W->transport->wake_fd = fd;
+}
 
 // --- Raw Sending ---
-void send_raw(const char *data) {
-    if (!peer_known) return;
-    sendto(sockfd, data, strlen(data), 0, (struct sockaddr*)&peer_addr, sizeof(peer_addr));
+void send_raw_len(NetSession *s, const char *data, int len) {
+    if (!s || len > NET_MAX_DATAGRAM) return;
+    if (W->tx_count == NET_IO_BATCH) tx_submit();
+    TxSlot *slot = &W->tx_batch[W->tx_count++];
+    slot->addr = s->addr;
+    slot->len = len;
+    memcpy(slot->data, data, len);
+    s->last_sent = W->timers.now;
+}
+
+void send_raw(NetSession *s, const char *data) {
+    send_raw_len(s, data, strlen(data));
+}
+
+// --- Spectator Fan-out ---
+bool net_watch_battle(NetSession *spectator, NetSession *battle) {
+    if (!spectator) return false;
+    if (!battle) {
+        if (W->server_mode) return false;
+        // Host mode: attach once the opponent shows up
+        spectator->wants_primary = true;
+        return true;
+    }
+    if (battle == spectator || spectator->watching == battle) return battle != spectator;
+    if (battle->spectator_count >= NET_MAX_SPECTATORS) {
+        LOG_WARN("[NET] Battle %u is full of spectators\n", battle->session_id);
+        return false;
+    }
+    if (!battle->bcast_buf) {
+        battle->bcast_buf = malloc(NET_MAX_DATAGRAM);
+        if (!battle->bcast_buf) return false;
+        battle->mem_bytes += NET_MAX_DATAGRAM;
+        W->total_mem_bytes += NET_MAX_DATAGRAM;
+    }
+    if (battle->spectator_count == battle->spectator_cap) {
+        int cap = battle->spectator_cap ? battle->spectator_cap * 2 : 8;
+        NetSession **grown = realloc(battle->spectators, cap * sizeof(NetSession *));
+        if (!grown) return false;
+        battle->mem_bytes += (cap - battle->spectator_cap) * sizeof(NetSession *);
+        W->total_mem_bytes += (cap - battle->spectator_cap) * sizeof(NetSession *);
+        battle->spectators = grown;
+        battle->spectator_cap = cap;
+    }
+    if (spectator->watching) net_unwatch_battle(spectator);
+    battle->spectators[battle->spectator_count++] = spectator;
+    spectator->watching = battle;
+    spectator->wants_primary = false;
+    return true;
+}
+
+void net_unwatch_battle(NetSession *spectator) {
+    NetSession *b = spectator->watching;
+    if (!b) return;
+    for (int k = 0; k < b->spectator_count; k++) {
+        if (b->spectators[k] == spectator) {
+            b->spectators[k] = b->spectators[--b->spectator_count];
+            break;
+        }
+    }
+    spectator->watching = NULL;
+}
+
+static void attach_waiting_spectators(NetSession *battle) {
+    for (unsigned int i = 0; i <= W->table_mask; i++) {
+        NetSession *s = W->session_table[i];
+        if (s && s->wants_primary) net_watch_battle(s, battle);
+    }
+}
+
+// Sends the battle's encoded events to every spectator. The event bytes are
+// shared; only the small session_id header differs per subscriber.
+static void flush_broadcast(NetSession *b) {
+    if (b->bcast_len == 0) return;
+    if (b->spectator_count == 0) {
+        b->bcast_len = 0;
+        return;
+    }
+    NetDatagram out[NET_FANOUT_BATCH];
+    char hdr[NET_FANOUT_BATCH][24];
+    for (int k = 0; k < b->spectator_count; k += NET_FANOUT_BATCH) {
+        int n = b->spectator_count - k;
+        if (n > NET_FANOUT_BATCH) n = NET_FANOUT_BATCH;
+        for (int j = 0; j < n; j++) {
+            NetSession *spec = b->spectators[k + j];
+            out[j].addr = spec->addr;
+            out[j].head = hdr[j];
+            out[j].head_len = snprintf(hdr[j], sizeof(hdr[j]), "session_id: %u\n", spec->session_id);
+            out[j].data = b->bcast_buf;
+            out[j].len = b->bcast_len;
+            spec->last_sent = W->timers.now;
+        }
+        // A full socket buffer drops the rest; spectators recover via snapshot
+        W->transport->send_batch(W->transport, out, n);
+        count_datagrams(METRIC_DATAGRAMS_SENT, METRIC_BYTES_SENT, out, n);
+    }
+    b->bcast_len = 0;
+}
+
+// Queues one frame for the battle's spectators; it goes out after the
+// players' own traffic on the next flush
+static void broadcast_event(NetSession *b, const char *origin, const char *frame, int len) {
+    if (!b || b->spectator_count == 0) return;
+    char hdr[64];
+    int hlen = snprintf(hdr, sizeof(hdr), "event_seq: %u\norigin: %s\n", ++b->event_seq, origin);
+    int need = hlen + len + (b->bcast_len > 0 ? 1 : 0);
+    if (b->bcast_len > 0 && b->bcast_len + need > NET_MTU) {
+        flush_broadcast(b);
+        need = hlen + len;
+    }
+    if (need > NET_MAX_DATAGRAM) return; // too big to fan out
+    if (b->bcast_len > 0) b->bcast_buf[b->bcast_len++] = '\n';
+    memcpy(b->bcast_buf + b->bcast_len, hdr, hlen);
+    memcpy(b->bcast_buf + b->bcast_len + hlen, frame, len);
+    b->bcast_len += hlen + len;
+    mark_dirty(b);
+}
+
+static bool is_broadcast_type(MessageType type) {
+    return (type >= MSG_BATTLE_SETUP && type <= MSG_GAME_OVER) || type == MSG_CHAT_MESSAGE;
 }
 
 // --- Parsing Helper ---
 void parse_kv(char *buffer, GameMessage *msg) {
+    PROFILE_SCOPE(PROF_PARSE_KV);
 
     strncpy(msg->raw_buffer, buffer, 4095);
     msg->raw_buffer[4095] = '\0';
     
-    char *line = strtok(buffer, "\n");
+    // strtok_r: server workers and the verifier parse on several threads
+    char *save = NULL;
+    char *line = strtok_r(buffer, "\n", &save);
     while (line) {
         char *sep = strchr(line, ':');
         if (sep) {
@@ -121,35 +1013,96 @@ void parse_kv(char *buffer, GameMessage *msg) {
 
             if (strcmp(line, "message_type") == 0) strncpy(msg->message_type, val, 31);
             else if (strcmp(line, "move_name") == 0) strncpy(msg->move_name, val, 31);
+            else if (strcmp(line, "move_used") == 0) strncpy(msg->move_name, val, 31); // CALCULATION_REPORT
             else if (strcmp(line, "attacker") == 0) strncpy(msg->attacker, val, 31); // Added to struct
             else if (strcmp(line, "winner") == 0) strncpy(msg->winner, val, 31);
             else if (strcmp(line, "damage_dealt") == 0) msg->damage_dealt = atoi(val);
             else if (strcmp(line, "defender_hp_remaining") == 0) msg->defender_hp_remaining = atoi(val);
-            else if (strcmp(line, "seed") == 0) set_shared_rng_seed(atoi(val));
+            else if (strcmp(line, "seed") == 0) {
+                msg->seed = (unsigned int)strtoul(val, NULL, 10);
+                msg->has_seed = true;
+            }
+            else if (strcmp(line, "event_seq") == 0) msg->event_seq = (unsigned int)strtoul(val, NULL, 10);
+            else if (strcmp(line, "origin") == 0) strncpy(msg->origin, val, 15);
+            else if (strcmp(line, "battle_id") == 0) msg->battle_id = (unsigned int)strtoul(val, NULL, 10);
+            else if (strcmp(line, "turn_number") == 0) msg->turn_number = (unsigned int)strtoul(val, NULL, 10);
+            else if (strcmp(line, "state_digest") == 0) strncpy(msg->state_digest, val, 16);
         }
-        line = strtok(NULL, "\n");
+        line = strtok_r(NULL, "\n", &save);
     }
+    msg->type = message_type_from_string(msg->message_type);
 }
 
 // --- Public Sending ---
+NetLane net_lane_for_type(MessageType type) {
+    switch (type) {
+    case MSG_CHAT_MESSAGE:
+    case MSG_STICKER_OFFER:
+    case MSG_STICKER_ACK:
+        return NET_LANE_CHAT;
+    case MSG_STICKER_CHUNK:
+        return NET_LANE_BULK;
+    default:
+        return NET_LANE_GAME;
+    }
+}
+
 void net_send_game_message(const char *type, const char *extra_data) {
-    local_seq++;
+    NetSession *s = W ? W->active : NULL; // no worker: offline replay
+    if (!s) return;
+    MessageType mtype = message_type_from_string(type);
+    NetLane lane = net_lane_for_type(mtype);
+    LaneState *ls = &s->lanes[lane];
+    if (ls->out_count >= MAX_PENDING) {
+        LOG_WARN("[NET] %s queue full, dropping %s\n", LANE_NAMES[lane], type);
+        return;
+    }
+
     char buffer[4096];
-    // Construct RFC compliant message
-    int len = snprintf(buffer, sizeof(buffer), 
+    // Construct RFC compliant message; non-game lanes name their channel
+    int len = snprintf(buffer, sizeof(buffer),
         "message_type: %s\n"
         "sequence_number: %d\n"
-        "%s", type, local_seq, extra_data ? extra_data : "");
+        "%s%s%s"
+        "%s", type, ls->local_seq + 1,
+        lane != NET_LANE_GAME ? "channel: " : "", lane != NET_LANE_GAME ? LANE_NAMES[lane] : "",
+        lane != NET_LANE_GAME ? "\n" : "", extra_data ? extra_data : "");
+    if (len >= (int)sizeof(buffer)) len = sizeof(buffer) - 1;
+
+    if (s->mem_bytes + len + 1 > NET_SESSION_MEM_LIMIT) {
+        LOG_WARN("[NET] Session %u over memory budget, dropping %s\n", s->session_id, type);
+        return;
+    }
+
+    PendingPacket *pkt = &ls->outgoing[(ls->out_head + ls->out_count) % MAX_PENDING];
+    pkt->payload = malloc(len + 1);
+    if (!pkt->payload) return;
+    memcpy(pkt->payload, buffer, len + 1);
+    s->mem_bytes += len + 1;
+    W->total_mem_bytes += len + 1;
+
+    // Store for reliability; the next flush puts it on the wire
+    ls->local_seq++;
+    pkt->active = true;
+    pkt->len = len;
+    pkt->seq = ls->local_seq;
+    pkt->retries = 0;
+    pkt->last_sent = 0;
+    pkt->due = false;
+    ls->out_count++;
+    mark_dirty(s);
 
-    // Store for reliability
-    outgoing.active = true;
-    outgoing.seq = local_seq;
-    outgoing.retries = 0;
-    outgoing.last_sent = current_time_ms();
-    strncpy(outgoing.payload, buffer, sizeof(outgoing.payload));
+    if (s->spectator_count > 0 && is_broadcast_type(mtype))
+        broadcast_event(s, "host", buffer, len);
 
-    send_raw(buffer);
-    printf("[NET] Sent Seq %d: %s\n", local_seq, type);
+    // Sticker chunks and their ACKs would drown the log
+    if (!W->server_mode && mtype != MSG_STICKER_CHUNK && mtype != MSG_STICKER_ACK)
+        LOG_DEBUG("[NET] Sent Seq %d: %s\n", ls->local_seq, type);
+}
+
+int net_send_capacity(NetLane lane) {
+    NetSession *s = W->active;
+    return s ? MAX_PENDING - s->lanes[lane].out_count : 0;
 }
 
 void net_send_chat(const char *sender, const char *text) {
@@ -160,76 +1113,607 @@ void net_send_chat(const char *sender, const char *text) {
     net_send_game_message("CHAT_MESSAGE", extra);
 }
 
-// --- Processing Loop ---
-bool net_process_updates(GameMessage *out_msg) {
-    // 1. Handle Retries
-    if (outgoing.active) {
-        if (current_time_ms() - outgoing.last_sent > RETRY_DELAY_MS) {
-            if (outgoing.retries < MAX_RETRIES) {
-                printf("[NET] Timeout. Retrying Seq %d (%d/%d)\n", outgoing.seq, outgoing.retries+1, MAX_RETRIES);
-                send_raw(outgoing.payload);
-                outgoing.retries++;
-                outgoing.last_sent = current_time_ms();
-            } else {
-                printf("[NET] Connection Lost (Max Retries).\n");
-                outgoing.active = false; 
-                // In real app, trigger game over here
+// --- Coalescing ---
+static void release_packet(NetSession *s, PendingPacket *pkt) {
+    pkt->active = false;
+    timer_cancel(&W->timers, &pkt->retry);
+    if (pkt->payload) {
+        s->mem_bytes -= pkt->len + 1;
+        W->total_mem_bytes -= pkt->len + 1;
+        free(pkt->payload);
+        pkt->payload = NULL;
+    }
+}
+
+static void trim_queue(LaneState *ls) {
+    // Drop acknowledged / abandoned slots from the head
+    while (ls->out_count > 0 && !ls->outgoing[ls->out_head].active) {
+        ls->out_head = (ls->out_head + 1) % MAX_PENDING;
+        ls->out_count--;
+    }
+}
+
+// RETRY_DELAY_MS for the first MAX_RETRIES retries, then doubling up to
+// RETRY_MAX_DELAY_MS
+static int retry_delay_ms(int retries) {
+    int delay = RETRY_DELAY_MS;
+    for (int r = MAX_RETRIES; r < retries && delay < RETRY_MAX_DELAY_MS; r++) delay *= 2;
+    return delay < RETRY_MAX_DELAY_MS ? delay : RETRY_MAX_DELAY_MS;
+}
+
+// Packs one session's staged frames, due retransmits and pending ACKs into as
+// few datagrams as fit in NET_MTU. Frames are separated by a blank line.
+// Lanes go in strict priority order (game, chat, bulk), so turn traffic is
+// always at the front of the batch.
+static void flush_session(NetSession *s, long long now) {
+    char dgram[NET_MAX_DATAGRAM];
+    int dlen = 0;
+
+    // Datagram header: session_id, then the cumulative ACK of each lane that owes one
+    int base_len = (s->session_id != 0) ? snprintf(dgram, sizeof(dgram), "session_id: %u\n", s->session_id) : 0;
+    dlen = base_len;
+    bool ack_in_header = false;
+    for (int l = 0; l < NET_LANE_COUNT; l++) {
+        if (!s->lanes[l].ack_pending) continue;
+        dlen += snprintf(dgram + dlen, sizeof(dgram) - dlen, "%s: %d\n", LANE_ACK_KEYS[l], s->lanes[l].remote_seq);
+        ack_in_header = true;
+    }
+    int ack_len = dlen - base_len;
+    int header_len = dlen;
+    bool sent_data = false;
+
+    for (int l = 0; l < NET_LANE_COUNT; l++) {
+        LaneState *ls = &s->lanes[l];
+        for (int i = 0; i < ls->out_count; i++) {
+            PendingPacket *pkt = &ls->outgoing[(ls->out_head + i) % MAX_PENDING];
+            if (!pkt->active) continue;
+
+            if (pkt->last_sent != 0) {
+                if (!pkt->due) continue;
+                // Lanes deliver in order, so a frame given up would wedge its
+                // lane for good: keep resending, slower, until the session is
+                // evicted or the turn timer ends the battle. Only the lane's
+                // head warns; the frames behind it wait on the same loss.
+                if (pkt->retries == MAX_RETRIES && i == 0)
+                    LOG_WARN("[NET] %s Seq %d unanswered after %d retries, backing off\n", LANE_NAMES[l], pkt->seq, MAX_RETRIES);
+                if (pkt->retries == MAX_RETRIES) metrics_add(METRIC_RETRY_STALLS, 1);
+                pkt->retries++;
+                metrics_add(METRIC_RETRANSMITS, 1);
+                if (l != NET_LANE_BULK)
+                    LOG_INFO("[NET] Timeout. Retrying %s Seq %d (retry %d)\n", LANE_NAMES[l], pkt->seq, pkt->retries);
             }
+
+            int need = pkt->len + (dlen > header_len ? 1 : 0);
+            if (dlen > header_len && dlen + need > NET_MTU) {
+                send_raw_len(s, dgram, dlen);
+                dlen = header_len = base_len;
+                need = pkt->len;
+            }
+            if (dlen + need > (int)sizeof(dgram)) continue; // can't happen: payload < datagram
+            if (dlen > header_len) dgram[dlen++] = '\n';
+            memcpy(dgram + dlen, pkt->payload, pkt->len);
+            dlen += pkt->len;
+            if (pkt->last_sent == 0) pkt->first_sent_us = now_us();
+            pkt->last_sent = now;
+            pkt->due = false;
+            timer_arm(&W->timers, &pkt->retry, now + retry_delay_ms(pkt->retries));
+            sent_data = true;
+        }
+        trim_queue(ls);
+    }
+
+    if (dlen > header_len) {
+        send_raw_len(s, dgram, dlen);
+    } else if (ack_in_header && !sent_data && now >= s->ack_due) {
+        // Nothing to ride on and the ACKs can't wait any longer
+        char ack_pkt[160];
+        int alen = snprintf(ack_pkt, sizeof(ack_pkt), "%.*smessage_type: ACK\n%.*s",
+                            base_len, dgram, ack_len, dgram + base_len);
+        send_raw_len(s, ack_pkt, alen);
+        sent_data = true;
+    }
+    if (sent_data) {
+        // The ACKs rode along
+        for (int l = 0; l < NET_LANE_COUNT; l++) s->lanes[l].ack_pending = false;
+        timer_cancel(&W->timers, &s->ack_timer);
+    }
+}
+
+// Keepalive: a standalone ACK of every lane, so the peer's idle timer resets
+// and it learns our receive state even when nobody is talking
+static void send_bare_ack(NetSession *s) {
+    char pkt[160];
+    int len = (s->session_id != 0) ? snprintf(pkt, sizeof(pkt), "session_id: %u\n", s->session_id) : 0;
+    for (int l = 0; l < NET_LANE_COUNT; l++)
+        len += snprintf(pkt + len, sizeof(pkt) - len, "%s: %d\n", LANE_ACK_KEYS[l], s->lanes[l].remote_seq);
+    len += snprintf(pkt + len, sizeof(pkt) - len, "message_type: ACK\n");
+    send_raw_len(s, pkt, len);
+    mark_dirty(s); // the next flush submits it
+}
+
+void net_flush(void) {
+    long long now = now_ms();
+    NetSession *list = W->dirty_head;
+    W->dirty_head = NULL;
+    NetSession *fanout = NULL;
+    while (list) {
+        NetSession *s = list;
+        list = s->next_dirty;
+        s->in_dirty = false;
+        flush_session(s, now);
+        if (s->bcast_len > 0) {
+            // Players first; spectators get their copy afterwards
+            s->next_dirty = fanout;
+            fanout = s;
         }
+        // Work left behind (retries, a delayed ACK) has a timer that
+        // marks the session dirty again when it falls due
     }
+    tx_submit();
+    while (fanout) {
+        NetSession *s = fanout;
+        fanout = s->next_dirty;
+        flush_broadcast(s);
+    }
+}
+
+static void handle_ack(NetSession *s, LaneState *ls, int ack) {
+    // Cumulative: everything up to ack has arrived in order. Only frames
+    // sent once give an RTT sample; a retransmit's ACK could be for either copy.
+    for (int i = 0; i < ls->out_count; i++) {
+        PendingPacket *pkt = &ls->outgoing[(ls->out_head + i) % MAX_PENDING];
+        if (!pkt->active || pkt->seq > ack) continue;
+        if (pkt->last_sent != 0 && pkt->retries == 0) metrics_observe(METRIC_ACK_RTT, now_us() - pkt->first_sent_us);
+        release_packet(s, pkt);
+    }
+    trim_queue(ls);
+    // A closing session can go as soon as its last frame is acknowledged,
+    // not at its next RETRY_DELAY_MS check
+    if (s->closing && !session_has_queued(s)) timer_arm(&W->timers, &s->evict_timer, now_ms());
+}
 
-    // 2. Receive
-    char buf[4096];
-    struct sockaddr_in sender;
-    socklen_t slen = sizeof(sender);
-    int len = recvfrom(sockfd, buf, sizeof(buf)-1, 0, (struct sockaddr*)&sender, &slen);
-
-    if (len > 0) {
-        buf[len] = 0;
-        
-        // Auto-detect peer if Joiner talks to Host
-        if (!peer_known) {
-            peer_addr = sender;
-            peer_known = true;
-            printf("[NET] Peer connected from %s\n", inet_ntoa(sender.sin_addr));
+static void schedule_ack(NetSession *s, LaneState *ls) {
+    if (!ls->ack_pending) {
+        // The first owed ACK on any lane sets the deadline for all of them
+        bool any = false;
+        for (int l = 0; l < NET_LANE_COUNT; l++) any = any || s->lanes[l].ack_pending;
+        if (!any) {
+            s->ack_due = now_ms() + ACK_DELAY_MS;
+            timer_arm(&W->timers, &s->ack_timer, s->ack_due);
         }
+        ls->ack_pending = true;
+    }
+    mark_dirty(s);
+}
 
-        // Extract Headers
-        int seq = -1, ack = -1;
-        char *p = strstr(buf, "sequence_number: ");
-        if (p) seq = atoi(p + 17);
-        p = strstr(buf, "ack_number: ");
-        if (p) ack = atoi(p + 12);
-
-        // Handle ACK
-        if (ack != -1) {
-            if (outgoing.active && outgoing.seq == ack) {
-                // printf("[NET] ACK Received for %d\n", ack);
-                outgoing.active = false;
+// Value of a "key: value" header line; only whole lines match, so a chat
+// message that mentions a key can't pose as one
+static const char *frame_header(const char *frame, const char *key) {
+    size_t klen = strlen(key);
+    for (const char *line = frame; line && *line; ) {
+        if (strncmp(line, key, klen) == 0 && line[klen] == ':')
+            return line + klen + (line[klen + 1] == ' ' ? 2 : 1);
+        // Headers come before the message body
+        if (strncmp(line, "message_text:", 13) == 0 || strncmp(line, "sticker_data:", 13) == 0) break;
+        line = strchr(line, '\n');
+        if (line) line++;
+    }
+    return NULL;
+}
+
+static NetLane frame_lane(const char *frame) {
+    const char *ch = frame_header(frame, "channel");
+    if (ch) {
+        for (int l = 1; l < NET_LANE_COUNT; l++)
+            if (strncmp(ch, LANE_NAMES[l], 4) == 0) return (NetLane)l;
+    }
+    return NET_LANE_GAME;
+}
+
+// Splits the next frame off rx_next; returns NULL when the datagram is used up
+static char *next_frame(void) {
+    char *frame = W->rx_next;
+    if (!frame || !*frame) {
+        W->rx_next = NULL;
+        return NULL;
+    }
+    char *end = strstr(frame, "\n\n");
+    if (end) {
+        end[1] = 0;
+        W->rx_next = end + 2;
+    } else {
+        W->rx_next = NULL;
+    }
+    return frame;
+}
+
+// `pokemon metrics <port>`: answered straight away, outside any session, and
+// only to processes on this machine
+static void answer_metrics_request(const struct sockaddr_in *from) {
+    if ((ntohl(from->sin_addr.s_addr) >> 24) != 127) return;
+    char text[NET_MAX_DATAGRAM];
+    NetDatagram d = {0};
+    d.addr = *from;
+    d.data = text;
+    d.len = metrics_format(text, sizeof(text));
+    W->transport->send_batch(W->transport, &d, 1);
+}
+
+// --- Sharded Servers ---
+// SO_REUSEPORT workers each see only the peers the kernel hashes to them, so
+// a spectator can land on a worker that doesn't have its battle. The workers
+// list their battles in one registry; the spectator's session then moves to
+// the owner, and a stub left behind forwards whatever the kernel keeps
+// delivering here. Nothing on the turn path takes the registry lock: only
+// opening, closing and handing over a session do.
+
+static struct {
+    unsigned int *ids;
+    NetWorker **owners;  // NULL = free slot
+    unsigned int mask;
+    int count;
+    int capacity;
+} registry;
+
+#ifndef _WIN32
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+#define REGISTRY_LOCK() pthread_mutex_lock(&registry_lock)
+#define REGISTRY_UNLOCK() pthread_mutex_unlock(&registry_lock)
+#else
+#define REGISTRY_LOCK()
+#define REGISTRY_UNLOCK()
+#endif
+
+static unsigned int registry_home(unsigned int id) {
+    return (id * 0x9E3779B1u) & registry.mask;
+}
+
+static void registry_add(NetSession *s) {
+    REGISTRY_LOCK();
+    if (registry.count < registry.capacity) {
+        unsigned int i = registry_home(s->session_id);
+        while (registry.owners[i]) i = (i + 1) & registry.mask;
+        registry.ids[i] = s->session_id;
+        registry.owners[i] = W;
+        registry.count++;
+        s->registered = true;
+    }
+    REGISTRY_UNLOCK();
+}
+
+static void registry_remove(NetSession *s) {
+    REGISTRY_LOCK();
+    unsigned int i = registry_home(s->session_id);
+    while (registry.owners[i] && (registry.ids[i] != s->session_id || registry.owners[i] != W))
+        i = (i + 1) & registry.mask;
+    if (registry.owners[i]) {
+        // Backward-shift delete, as in the session table
+        registry.owners[i] = NULL;
+        registry.count--;
+        unsigned int j = i;
+        for (;;) {
+            j = (j + 1) & registry.mask;
+            if (!registry.owners[j]) break;
+            unsigned int k = registry_home(registry.ids[j]);
+            bool movable = (j > i) ? (k <= i || k > j) : (k <= i && k > j);
+            if (movable) {
+                registry.ids[i] = registry.ids[j];
+                registry.owners[i] = registry.owners[j];
+                registry.owners[j] = NULL;
+                i = j;
+            }
+        }
+    }
+    s->registered = false;
+    REGISTRY_UNLOCK();
+}
+
+// Another worker holding a battle under id, or NULL
+static NetWorker *registry_owner(unsigned int id) {
+    NetWorker *owner = NULL;
+    REGISTRY_LOCK();
+    if (registry.owners) {
+        for (unsigned int i = registry_home(id); registry.owners[i]; i = (i + 1) & registry.mask) {
+            if (registry.ids[i] == id && registry.owners[i] != W) {
+                owner = registry.owners[i];
+                break;
+            }
+        }
+    }
+    REGISTRY_UNLOCK();
+    return owner;
+}
+
+bool net_worker_share_battles(NetWorker *w, int total_sessions) {
+#ifdef _WIN32
+    (void)w;
+    (void)total_sessions;
+    return false; // one worker per server here
+#else
+    REGISTRY_LOCK();
+    if (!registry.owners) {
+        unsigned int size = 16;
+        while (size < (unsigned int)total_sessions * 2) size <<= 1;
+        registry.ids = calloc(size, sizeof(unsigned int));
+        registry.owners = calloc(size, sizeof(NetWorker *));
+        if (!registry.ids || !registry.owners) {
+            free(registry.ids);
+            free(registry.owners);
+            registry.ids = NULL;
+            registry.owners = NULL;
+        } else {
+            registry.mask = size - 1;
+            registry.capacity = total_sessions;
+        }
+    }
+    bool ok = registry.owners != NULL;
+    REGISTRY_UNLOCK();
+    if (!ok || pipe(w->wake_pipe) != 0) return false;
+    for (int k = 0; k < 2; k++) fcntl(w->wake_pipe[k], F_SETFL, fcntl(w->wake_pipe[k], F_GETFL, 0) | O_NONBLOCK);
+    pthread_mutex_init(&w->inbox_lock, NULL);
+    w->transport->wake_fd = w->wake_pipe[0];
+    w->shares_battles = true;
+    return true;
+#endif
+}
+
+static void inbox_post(NetWorker *to, InboxItem *item) {
+#ifndef _WIN32
+    item->next = NULL;
+    pthread_mutex_lock(&to->inbox_lock);
+    if (to->inbox_tail) to->inbox_tail->next = item;
+    else __atomic_store_n(&to->inbox_head, item, __ATOMIC_RELEASE);
+    to->inbox_tail = item;
+    pthread_mutex_unlock(&to->inbox_lock);
+    if (!__atomic_exchange_n(&to->wake_pending, 1, __ATOMIC_ACQ_REL)) {
+        char c = 0;
+        if (write(to->wake_pipe[1], &c, 1) < 0) {} // pipe full: it is awake anyway
+    }
+#else
+    (void)to;
+    free(item);
+#endif
+}
+
+static InboxItem *inbox_take(void) {
+#ifndef _WIN32
+    if (__atomic_load_n(&W->wake_pending, __ATOMIC_ACQUIRE)) {
+        // Only a byte actually read re-arms the wakeup; one still on its way
+        // wakes the next poll instead
+        char c;
+        if (read(W->wake_pipe[0], &c, 1) == 1) __atomic_store_n(&W->wake_pending, 0, __ATOMIC_RELEASE);
+    }
+    if (!__atomic_load_n(&W->inbox_head, __ATOMIC_ACQUIRE)) return NULL;
+    pthread_mutex_lock(&W->inbox_lock);
+    InboxItem *item = W->inbox_head;
+    __atomic_store_n(&W->inbox_head, item->next, __ATOMIC_RELEASE);
+    if (!item->next) W->inbox_tail = NULL;
+    pthread_mutex_unlock(&W->inbox_lock);
+    return item;
+#else
+    return NULL;
+#endif
+}
+
+static InboxItem *inbox_item(const struct sockaddr_in *addr, const char *data, int len) {
+    InboxItem *item = malloc(sizeof(InboxItem) + len + 1);
+    if (!item) return NULL;
+    item->next = NULL;
+    item->session = NULL;
+    item->addr = *addr;
+    item->len = len;
+    memcpy(item->data, data, len);
+    item->data[len] = 0;
+    return item;
+}
+
+bool net_hand_over_spectator(NetSession *spectator, unsigned int battle_id, const GameMessage *request) {
+    if (!spectator || !W->shares_battles || spectator->handed_over || spectator->hand_over_to) return false;
+    NetWorker *owner = registry_owner(battle_id);
+    if (!owner) return false;
+    spectator->hand_over_frame = malloc(strlen(request->raw_buffer) + 1);
+    if (!spectator->hand_over_frame) return false;
+    strcpy(spectator->hand_over_frame, request->raw_buffer);
+    spectator->hand_over_to = owner;
+    spectator->next_hand_over = W->hand_over_head;
+    W->hand_over_head = spectator;
+    return true;
+}
+
+// Runs between datagrams, after a flush, so no session is mid-read or dirty
+static void pass_on_spectators(void) {
+    while (W->hand_over_head) {
+        NetSession *s = W->hand_over_head;
+        W->hand_over_head = s->next_hand_over;
+        NetWorker *to = s->hand_over_to;
+        InboxItem *item = inbox_item(&s->addr, s->hand_over_frame, (int)strlen(s->hand_over_frame));
+        free(s->hand_over_frame);
+        s->hand_over_frame = NULL;
+        s->hand_over_to = NULL;
+        if (!item) continue; // it stays here and is refused on its next request
+
+        session_timers_cancel(s);
+        session_unlink(s);
+        if (s->registered) registry_remove(s);
+        s->handed_over = true;
+        // The owner replays the request, so it has to be accepted again
+        LaneState *ls = &s->lanes[NET_LANE_GAME];
+        const char *seq = frame_header(item->data, "sequence_number");
+        if (seq && atoi(seq) == ls->remote_seq) ls->remote_seq--;
+
+        NetSession *stub = session_create(&s->addr, s->session_id);
+        if (stub) {
+            timer_cancel(&W->timers, &stub->keepalive_timer); // it never sends
+            stub->forward_to = to;
+        }
+        item->session = s;
+        inbox_post(to, item);
+    }
+}
+
+// Files a session another worker passed on and restarts its timers here
+static bool adopt_session(NetSession *s) {
+    if (W->session_count >= W->max_sessions) {
+        LOG_WARN("[NET] Session table full, dropping spectator %u\n", s->session_id);
+        session_release(s);
+        return false;
+    }
+    s->last_heard = now_ms();
+    session_timers_init(s);
+    session_link(s);
+    registry_add(s);
+    for (int l = 0; l < NET_LANE_COUNT; l++) {
+        for (int i = 0; i < MAX_PENDING; i++) {
+            PendingPacket *pkt = &s->lanes[l].outgoing[i];
+            if (pkt->active && pkt->last_sent != 0) timer_arm(&W->timers, &pkt->retry, s->last_heard + RETRY_DELAY_MS);
+        }
+        if (s->lanes[l].ack_pending) timer_arm(&W->timers, &s->ack_timer, s->ack_due);
+    }
+    mark_dirty(s);
+    return true;
+}
+
+// Takes the next datagram and resolves its session; false once the socket is
+// empty. Datagrams nobody can own are skipped.
+static bool receive_datagram(void) {
+    for (;;) {
+        char *rx_buf;
+        int rx_len;
+        struct sockaddr_in sender;
+        InboxItem *item = W->shares_battles ? inbox_take() : NULL;
+        if (item) {
+            // From another worker: a spectator to take over (its request
+            // comes out next), or a datagram for one taken over earlier
+            free(W->rx_item);
+            W->rx_item = item;
+            if (item->session) {
+                if (!adopt_session(item->session)) continue;
+                W->rx_session = item->session;
+                W->rx_next = item->data;
+                return true;
+            }
+            rx_buf = item->data;
+            rx_len = item->len;
+            sender = item->addr;
+        } else {
+            if (W->rx_index >= W->rx_count && !rx_fill()) return false;
+            rx_buf = W->rx_batch[W->rx_index].data;
+            rx_len = W->rx_batch[W->rx_index].len;
+            sender = W->rx_batch[W->rx_index].addr;
+            W->rx_index++;
+        }
+
+        // Datagram header: session_id (absent from legacy peers = session 0)
+        unsigned int id = 0;
+        char *p = rx_buf;
+        if (strncmp(p, "session_id: ", 12) == 0) {
+            id = (unsigned int)strtoul(p + 12, NULL, 10);
+            char *eol = strchr(p, '\n');
+            p = eol ? eol + 1 : p + strlen(p);
+        }
+
+        NetSession *s = session_find(&sender, id);
+        if (s && s->forward_to) {
+            InboxItem *fwd = inbox_item(&sender, rx_buf, rx_len);
+            if (fwd) inbox_post(s->forward_to, fwd);
+            s->last_heard = now_ms();
+            continue;
+        }
+        if (!s && id == 0 && strncmp(p, METRICS_REQUEST, strlen(METRICS_REQUEST)) == 0) {
+            answer_metrics_request(&sender);
+            continue;
+        }
+        if (!s) {
+            // Stray ACKs and keepalives (e.g. for a session we already
+            // evicted) don't open a new one
+            if (!W->accept_sessions || !strstr(p, "sequence_number")) continue;
+            s = session_create(&sender, id);
+            if (!s) {
+                LOG_WARN("[NET] Session table full, ignoring %s\n", inet_ntoa(sender.sin_addr));
+                continue;
             }
-            return false; // ACKs are internal, don't pass to game logic
+            if (!W->server_mode) LOG_INFO("[NET] Peer connected from %s\n", inet_ntoa(sender.sin_addr));
+            if (W->shares_battles) registry_add(s);
+        }
+        s->last_heard = now_ms();
+        W->rx_session = s;
+        W->rx_next = p;
+        return true;
+    }
+}
+
+// --- Processing Loop ---
+bool net_process_updates(GameMessage *out_msg) {
+    // 1. Fire due timers, then send staged frames, retries and any ACK that
+    // is due. Mid-datagram, the rest of its frames come first.
+    if (!W->rx_next) {
+        W->rx_session = NULL;
+        run_timers();
+    }
+    net_flush();
+    if (!W->rx_next && W->hand_over_head) pass_on_spectators();
+
+    // 2. Receive (finish the previous datagram's frames first); keep reading
+    // past ACK-only datagrams until a message turns up or the socket is empty
+    for (;;) {
+        if (!W->rx_next) {
+            W->rx_session = NULL;
+            if (!receive_datagram()) return false;
         }
 
-        // Handle Incoming Message
-        if (seq != -1) {
-            // Send ACK immediately
-            char ack_pkt[64];
-            snprintf(ack_pkt, sizeof(ack_pkt), "message_type: ACK\nack_number: %d\n", seq);
-            send_raw(ack_pkt);
+        NetSession *s = W->rx_session;
+        char *buf;
+        while ((buf = next_frame()) != NULL) {
+            // Spectator feed: unreliable, no ACK; the embedded sequence and
+            // ACK numbers belong to the players' stream, not ours
+            if (strncmp(buf, "event_seq: ", 11) == 0) {
+                memset(out_msg, 0, sizeof(GameMessage));
+                parse_kv(buf, out_msg);
+                W->active = s;
+                return true;
+            }
 
-            // Deduplicate
-            if (seq <= remote_seq && remote_seq != 0) {
-                return false; // Duplicate
+            // Handle ACKs (standalone or piggybacked), one per lane
+            for (int l = 0; l < NET_LANE_COUNT; l++) {
+                const char *ack = frame_header(buf, LANE_ACK_KEYS[l]);
+                if (ack) handle_ack(s, &s->lanes[l], atoi(ack));
             }
-            remote_seq = seq;
+
+            // ACKs are internal, don't pass to game logic
+            const char *seq_field = frame_header(buf, "sequence_number");
+            if (!seq_field) continue;
+            int seq = atoi(seq_field);
+            LaneState *ls = &s->lanes[frame_lane(buf)];
+
+            // Every data frame gets (re-)acknowledged, duplicates included
+            schedule_ack(s, ls);
+
+            // Accept in order only (per lane), so the cumulative ACK stays
+            // truthful; duplicates and frames past a gap wait for the retry.
+            // Every lane starts at seq 1, so this holds for the first frame too.
+            if (seq != ls->remote_seq + 1) {
+                metrics_add(seq <= ls->remote_seq ? METRIC_DUPLICATES : METRIC_OUT_OF_ORDER, 1);
+                continue;
+            }
+            ls->remote_seq = seq;
 
             // Parse for Game Logic
             memset(out_msg, 0, sizeof(GameMessage));
             parse_kv(buf, out_msg);
+
+            // Host mode: the first joiner becomes the opponent
+            if (!W->server_mode && !W->primary && out_msg->type == MSG_HANDSHAKE_REQUEST) {
+                W->primary = s;
+                attach_waiting_spectators(s);
+            }
+            W->active = s;
+
+            // Relay what the opponent said to anyone watching
+            if (s->spectator_count > 0 && is_broadcast_type(out_msg->type))
+                broadcast_event(s, "joiner", out_msg->raw_buffer, strlen(out_msg->raw_buffer));
             return true;
         }
     }
-    return false;
 }
 
 // --- GLUE CODE FOR MEMBER 2 COMPATIBILITY ---
@@ -2,19 +2,67 @@
 #define NETWORK_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "game_logic.h" // Needed for GameMessage struct
+#include "timer_wheel.h"
 
 // --- Configuration ---
 #define NET_PORT 8080
 #define RETRY_DELAY_MS 500
-#define MAX_RETRIES 3
+#define MAX_RETRIES 3           // retries at RETRY_DELAY_MS; after that the delay doubles
+#define RETRY_MAX_DELAY_MS 4000 // backoff cap; a frame is resent until its session goes
+#define ACK_DELAY_MS 20         // how long an ACK may wait for a data frame to ride on
+#define NET_MTU 1200            // coalescing budget per datagram
+#define NET_MAX_DATAGRAM 8192
+#define MAX_PENDING 32          // unacknowledged messages in flight
+#define NET_IO_BATCH 32         // datagrams per recvmmsg/sendmmsg call
+
+// --- Sessions ---
+#define NET_DEFAULT_MAX_SESSIONS 64     // host/join: opponent plus spectators
+#define NET_SESSION_MEM_LIMIT (64 * 1024) // per-session cap: struct + queued payloads + charges
+#define NET_SESSION_IDLE_MS 30000
+#define NET_EVICT_RETRY_MS 1000 // eviction put off while the session is busy
+#define NET_KEEPALIVE_MS 5000   // bare ACK after this long without sending
+#define NET_MAX_SPECTATORS 1024
+#define NET_FANOUT_BATCH 64    // spectators per sendmmsg call
+
+// --- Lanes ---
+// Each session carries independent reliable channels, flushed in strict
+// priority order. The lane follows from the message type.
+typedef enum {
+    NET_LANE_GAME = 0, // turn traffic, handshakes, snapshots
+    NET_LANE_CHAT,     // chat lines, sticker offers and their ACKs
+    NET_LANE_BULK,     // sticker chunks
+    NET_LANE_COUNT
+} NetLane;
+
+// A remote endpoint (source address + session_id) with its own sequence
+// state, send queue and BattleContext. Opaque outside network.c.
+typedef struct NetSession NetSession;
+
+// One socket plus the sessions it serves. Every net_* call works on the
+// calling thread's current worker.
+typedef struct NetWorker NetWorker;
 
 // --- Lifecycle ---
 bool net_init(int port);
+// Server mode: up to max_sessions concurrent battles on one socket
+bool net_init_server(int port, int max_sessions, bool multi_battle);
 void net_cleanup(void);
 
+// --- Workers ---
+// reuse_port sets SO_REUSEPORT so several workers can share one port
+NetWorker *net_worker_create(int port, int max_sessions, bool multi_battle, bool reuse_port);
+void net_worker_destroy(NetWorker *w);
+// Makes w the calling thread's current worker
+void net_worker_select(NetWorker *w);
+NetWorker *net_current_worker(void);
+
 // --- Connection ---
 void net_set_peer(const char *ip, int port);
+// Opens one more outbound session to ip:port under a fresh session_id and
+// leaves the primary alone; a load generator runs many battles per worker
+NetSession *net_connect(const char *ip, int port);
 bool net_is_peer_set(void);
 
 // --- Sending (Reliable) ---
@@ -22,12 +70,94 @@ bool net_is_peer_set(void);
 void net_send_game_message(const char *type, const char *extra_data);
 // Sends a chat message (also reliable)
 void net_send_chat(const char *sender, const char *text);
+NetLane net_lane_for_type(MessageType type);
+// Free send-queue slots on one lane of the active session (senders back off at 0)
+int net_send_capacity(NetLane lane);
+// Pushes staged messages (and a pending ACK) out now instead of on the next poll
+void net_flush(void);
 
 // --- Receiving ---
+// Decodes one "key: value" message into *msg (the buffer is modified)
+void parse_kv(char *buffer, GameMessage *msg);
 // Call this every frame. It handles ACKs, Retries, and returns true if a 
 // new valid game message is ready in *out_msg.
 bool net_process_updates(GameMessage *out_msg);
 
+// --- Sessions ---
+// net_process_updates() makes the sender of the returned message the active
+// session; net_send_game_message() always goes to the active session.
+NetSession *net_active_session(void);
+NetSession *net_primary_session(void);
+void net_select_session(NetSession *s);
+unsigned int net_session_id(const NetSession *s);
+BattleContext *net_session_battle(NetSession *s);
+// Caller-owned pointer carried with the session
+void net_session_set_user(NetSession *s, void *user);
+void *net_session_user(const NetSession *s);
+// Marks a session to be evicted once everything it sent is acknowledged
+void net_session_close(NetSession *s);
+size_t net_session_memory_bytes(const NetSession *s);
+// Counts memory the caller holds for a session (a journal, say) against its
+// NET_SESSION_MEM_LIMIT and the worker total; a negative charge gives it back
+void net_session_charge_memory(NetSession *s, long bytes);
+int net_session_count(void);
+NetSession *net_find_session_by_id(unsigned int id);
+
+// --- Spectators ---
+// Subscribes a spectator session to a battle's event feed. In host mode a
+// NULL battle means "the opponent", attached as soon as one connects.
+bool net_watch_battle(NetSession *spectator, NetSession *battle);
+void net_unwatch_battle(NetSession *spectator);
+int net_spectator_count(const NetSession *s);
+NetSession *net_watched_battle(const NetSession *s);
+// Last feed event queued for a battle; snapshots are stamped with it
+unsigned int net_event_seq(const NetSession *s);
+size_t net_memory_bytes(void);
+
+// --- Sharded Servers ---
+// Workers sharing one SO_REUSEPORT port list their sessions in a process-wide
+// registry (room for total_sessions) so any of them can find a battle's owner
+bool net_worker_share_battles(NetWorker *w, int total_sessions);
+// Moves a spectator to the worker that owns battle_id once the current
+// datagram is done; request comes out of that worker's net_process_updates()
+// again, and later datagrams from the spectator are forwarded there. False
+// if no other worker has the battle.
+bool net_hand_over_spectator(NetSession *spectator, unsigned int battle_id, const GameMessage *request);
+
+// --- Timers ---
+// Deadlines live in the current worker's timer wheel (1 ms resolution on the
+// monotonic clock). Callbacks run inside net_process_updates() on that
+// worker's thread; net_wait() never sleeps past the earliest one.
+void net_timer_arm(TimerNode *t, int delay_ms); // re-arms if already pending
+void net_timer_cancel(TimerNode *t);
+
+// Turn timeouts: one per session, cancelled with it
+typedef void (*NetTurnTimeoutHandler)(NetSession *s, void *arg);
+void net_set_turn_timeout_handler(NetTurnTimeoutHandler handler, void *arg);
+void net_session_arm_turn_timer(NetSession *s, int timeout_ms); // (re)starts the clock
+void net_session_cancel_turn_timer(NetSession *s);
+bool net_session_turn_timer_armed(const NetSession *s);
+
+// --- I/O ---
+typedef struct {
+    unsigned long long rx_packets;
+    unsigned long long rx_syscalls;    // syscalls spent receiving (0 when io_uring is fed by multishot)
+    unsigned long long rx_empty_polls; // receive attempts that found nothing
+    unsigned long long tx_packets;
+    unsigned long long tx_syscalls;
+} NetIoStats;
+
+// Blocks until data arrives, the next timer is due or timeout_ms passes
+// (< 0: no limit besides timers); true if something is ready
+bool net_wait(int timeout_ms);
+// Also wake net_wait() when fd turns readable (e.g. stdin); -1 to stop
+void net_set_wake_fd(int fd);
+NetIoStats net_get_io_stats(void);
+// Earliest pending timer on the current worker, -1 if none
+long long net_next_deadline(void);
+// "socket" or "io_uring" (build with -DNET_USE_IO_URING on Linux)
+const char *net_transport_name(void);
+
 // --- Utils ---
 int net_get_next_sequence(void);
 const char* net_get_peer_ip(void);
@@ -0,0 +1,280 @@
+#include "profile.h"
+
+#ifdef PROFILE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <process.h>
+    #define getpid _getpid
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+#if defined(_MSC_VER)
+    #define PROFILE_THREAD_LOCAL __declspec(thread)
+#else
+    #define PROFILE_THREAD_LOCAL __thread
+#endif
+
+static const char *SCOPE_NAMES[PROF_SCOPE_COUNT] = {
+    [PROF_CALCULATE_DAMAGE] = "calculate_damage_logic",
+    [PROF_PARSE_KV] = "parse_kv",
+    [PROF_PARSE_CHAT] = "parse_chat_message",
+    [PROF_LOAD_POKEMON] = "load_pokemon_data",
+    [PROF_EVENT_LOOP] = "event_loop",
+};
+
+typedef struct {
+    int scope;
+    long long start_ns; // since the profiler's epoch
+    long long dur_ns;
+} ProfileEvent;
+
+typedef struct {
+    unsigned long long buckets[PROFILE_BUCKETS];
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+} ProfileHistogram;
+
+// One thread's events and histograms. Only that thread writes them; the exit
+// writer reads them as they stand.
+typedef struct {
+    int tid;
+    ProfileEvent *events;
+    int event_count;
+    unsigned long long dropped;
+    ProfileHistogram scopes[PROF_SCOPE_COUNT];
+} ProfileThread;
+
+static ProfileThread *threads[PROFILE_MAX_THREADS];
+static int threads_claimed;
+static long long epoch_ns;
+static int written;
+static PROFILE_THREAD_LOCAL ProfileThread *me;
+static PROFILE_THREAD_LOCAL int unregistered; // out of thread slots: not recorded
+
+static long long now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, t;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (long long)(t.QuadPart * (1e9 / freq.QuadPart));
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+static int bucket_of(long long ns) {
+    if (ns < 1) return 0;
+    int b = 64 - __builtin_clzll((unsigned long long)ns);
+    return b < PROFILE_BUCKETS ? b : PROFILE_BUCKETS - 1;
+}
+
+// Single writer, concurrent reader: relaxed load and store, no locked add
+static void bump(unsigned long long *x, unsigned long long n) {
+    __atomic_store_n(x, __atomic_load_n(x, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+// Servers only stop on a signal, and the trace can't be written from a
+// handler (stdio, malloc). The handler only wakes a thread that leaves
+// through exit(), so atexit() writes it there.
+#ifdef _WIN32
+// Console events already arrive on a thread of their own
+static BOOL WINAPI on_console_event(DWORD type) {
+    if (type != CTRL_C_EVENT && type != CTRL_BREAK_EVENT && type != CTRL_CLOSE_EVENT) return FALSE;
+    exit(128 + (type == CTRL_C_EVENT ? SIGINT : SIGTERM));
+}
+
+static void hook_signals(void) {
+    SetConsoleCtrlHandler(on_console_event, TRUE);
+}
+#else
+static volatile sig_atomic_t stop_signal;
+static int stop_pipe[2];
+
+static void on_signal(int sig) {
+    stop_signal = sig;
+    char c = 0;
+    if (write(stop_pipe[1], &c, 1) < 0) {} // async-signal-safe; nothing to do if it fails
+}
+
+static void *stop_loop(void *arg) {
+    (void)arg;
+    char c;
+    while (read(stop_pipe[0], &c, 1) != 1) {}
+    exit(128 + stop_signal);
+}
+
+// Without the thread the signals keep their default action: no trace
+static void hook_signals(void) {
+    pthread_t thread;
+    if (pipe(stop_pipe) != 0) return;
+    if (pthread_create(&thread, NULL, stop_loop, NULL) != 0) {
+        close(stop_pipe[0]);
+        close(stop_pipe[1]);
+        return;
+    }
+    pthread_detach(thread);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+}
+#endif
+
+// The first thread to record anything starts the clock and hooks exit
+static void start_once(long long now) {
+    long long expected = 0;
+    if (!__atomic_compare_exchange_n(&epoch_ns, &expected, now, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return;
+    atexit(profile_write);
+    hook_signals();
+}
+
+static ProfileThread *register_thread(void) {
+    int i = __atomic_fetch_add(&threads_claimed, 1, __ATOMIC_RELAXED);
+    if (i >= PROFILE_MAX_THREADS) return NULL;
+    ProfileThread *t = calloc(1, sizeof(ProfileThread));
+    if (!t) return NULL;
+    t->tid = i + 1;
+    t->events = malloc(PROFILE_MAX_EVENTS * sizeof(ProfileEvent));
+    __atomic_store_n(&threads[i], t, __ATOMIC_RELEASE);
+    return t;
+}
+
+// --- Recording ---
+ProfileTimer profile_begin(ProfileScope scope) {
+    ProfileTimer t = {scope, now_ns()};
+    return t;
+}
+
+void profile_end(ProfileTimer *timer) {
+    long long end = now_ns();
+    if (!me) {
+        if (unregistered) return;
+        start_once(timer->start_ns);
+        me = register_thread();
+        if (!me) {
+            unregistered = 1;
+            return;
+        }
+    }
+    long long dur = end - timer->start_ns;
+    ProfileHistogram *h = &me->scopes[timer->scope];
+    bump(&h->buckets[bucket_of(dur)], 1);
+    bump(&h->count, 1);
+    bump(&h->total_ns, (unsigned long long)dur);
+    if ((unsigned long long)dur > h->max_ns) __atomic_store_n(&h->max_ns, (unsigned long long)dur, __ATOMIC_RELAXED);
+
+    int n = me->event_count;
+    if (me->events && n < PROFILE_MAX_EVENTS) {
+        ProfileEvent *e = &me->events[n];
+        e->scope = timer->scope;
+        e->start_ns = timer->start_ns - epoch_ns;
+        e->dur_ns = dur;
+        __atomic_store_n(&me->event_count, n + 1, __ATOMIC_RELEASE);
+    } else {
+        bump(&me->dropped, 1);
+    }
+}
+
+// --- Output ---
+static long long percentile_ns(const ProfileHistogram *h, double q) {
+    if (h->count == 0) return 0;
+    unsigned long long rank = (unsigned long long)(q * h->count), seen = 0;
+    if (rank >= h->count) rank = h->count - 1;
+    int b;
+    for (b = 0; b < PROFILE_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) break;
+    }
+    // The bucket's upper edge, but never past the slowest sample
+    long long edge = 1LL << (b < PROFILE_BUCKETS ? b : PROFILE_BUCKETS - 1);
+    return edge < (long long)h->max_ns ? edge : (long long)h->max_ns;
+}
+
+void profile_write(void) {
+    if (__atomic_exchange_n(&written, 1, __ATOMIC_ACQ_REL)) return;
+    int n = __atomic_load_n(&threads_claimed, __ATOMIC_RELAXED);
+    if (n > PROFILE_MAX_THREADS) n = PROFILE_MAX_THREADS;
+
+    char path[256];
+    const char *env = getenv("PROFILE_OUT");
+    if (env && *env)
+        snprintf(path, sizeof(path), "%s", env);
+    else
+        snprintf(path, sizeof(path), "profile-%d.json", (int)getpid());
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "[PROFILE] Could not write %s\n", path);
+        return;
+    }
+
+    // Merge the threads' histograms while writing their events
+    ProfileHistogram total[PROF_SCOPE_COUNT];
+    memset(total, 0, sizeof(total));
+    unsigned long long events = 0, dropped = 0;
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    for (int i = 0; i < n; i++) {
+        ProfileThread *t = __atomic_load_n(&threads[i], __ATOMIC_ACQUIRE);
+        if (!t) continue;
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                first ? "" : ",\n", pid, t->tid, t->tid);
+        first = false;
+        int count = __atomic_load_n(&t->event_count, __ATOMIC_ACQUIRE);
+        for (int k = 0; k < count; k++) {
+            const ProfileEvent *e = &t->events[k];
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"pokemon\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    SCOPE_NAMES[e->scope], e->start_ns / 1000.0, e->dur_ns / 1000.0, pid, t->tid);
+        }
+        events += (unsigned long long)count;
+        dropped += t->dropped;
+        for (int s = 0; s < PROF_SCOPE_COUNT; s++) {
+            const ProfileHistogram *h = &t->scopes[s];
+            for (int b = 0; b < PROFILE_BUCKETS; b++) total[s].buckets[b] += h->buckets[b];
+            total[s].count += h->count;
+            total[s].total_ns += h->total_ns;
+            if (h->max_ns > total[s].max_ns) total[s].max_ns = h->max_ns;
+        }
+    }
+    fprintf(f, "\n],\n\"scopes\":{");
+
+    // Per-scope summary plus the raw histogram (upper bucket edge in ns -> count)
+    fprintf(stderr, "[PROFILE] %-24s %10s %10s %10s %10s %12s\n", "scope", "count", "mean ns", "p50 ns", "p99 ns", "max ns");
+    first = true;
+    for (int s = 0; s < PROF_SCOPE_COUNT; s++) {
+        const ProfileHistogram *h = &total[s];
+        if (h->count == 0) continue;
+        unsigned long long mean = h->total_ns / h->count;
+        fprintf(f, "%s\n\"%s\":{\"count\":%llu,\"total_ns\":%llu,\"mean_ns\":%llu,\"p50_ns\":%lld,\"p90_ns\":%lld,"
+                   "\"p99_ns\":%lld,\"max_ns\":%llu,\"histogram_ns\":{",
+                first ? "" : ",", SCOPE_NAMES[s], h->count, h->total_ns, mean, percentile_ns(h, 0.50),
+                percentile_ns(h, 0.90), percentile_ns(h, 0.99), h->max_ns);
+        first = false;
+        bool first_bucket = true;
+        for (int b = 0; b < PROFILE_BUCKETS; b++) {
+            if (h->buckets[b] == 0) continue;
+            fprintf(f, "%s\"%lld\":%llu", first_bucket ? "" : ",", 1LL << b, h->buckets[b]);
+            first_bucket = false;
+        }
+        fprintf(f, "}}");
+        fprintf(stderr, "[PROFILE] %-24s %10llu %10llu %10lld %10lld %12llu\n", SCOPE_NAMES[s], h->count, mean,
+                percentile_ns(h, 0.50), percentile_ns(h, 0.99), h->max_ns);
+    }
+    fprintf(f, "\n}}\n");
+    fclose(f);
+    fprintf(stderr, "[PROFILE] Wrote %s (%llu events, %llu past the buffer)\n", path, events, dropped);
+}
+
+#endif
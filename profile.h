@@ -0,0 +1,51 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Scope timers for the hot paths, compiled in with -DPROFILE and compiled out
+// entirely otherwise. Each thread appends complete events to its own buffer
+// and folds every duration into per-scope log2 histograms; at exit (or on
+// SIGINT/SIGTERM) everything is written as Chrome trace JSON, for
+// chrome://tracing or ui.perfetto.dev, to $PROFILE_OUT or profile-<pid>.json.
+//
+//   PROFILE_SCOPE(PROF_PARSE_KV);          // until the enclosing block ends
+//   PROFILE_BEGIN(t, PROF_EVENT_LOOP); ... PROFILE_END(t);
+
+#define PROFILE_MAX_THREADS 128
+#define PROFILE_MAX_EVENTS (1 << 16) // per thread; past that only the histograms grow
+#define PROFILE_BUCKETS 40           // bucket i holds [2^(i-1), 2^i) ns
+
+typedef enum {
+    PROF_CALCULATE_DAMAGE = 0,
+    PROF_PARSE_KV,
+    PROF_PARSE_CHAT,
+    PROF_LOAD_POKEMON,
+    PROF_EVENT_LOOP, // one pass of a main/server loop, not counting the wait
+    PROF_SCOPE_COUNT
+} ProfileScope;
+
+#ifdef PROFILE
+
+typedef struct {
+    ProfileScope scope;
+    long long start_ns;
+} ProfileTimer;
+
+ProfileTimer profile_begin(ProfileScope scope);
+void profile_end(ProfileTimer *t);
+// Writes the trace now; also runs from atexit()
+void profile_write(void);
+
+#define PROFILE_SCOPE(scope) \
+    ProfileTimer profile_scope_timer __attribute__((cleanup(profile_end))) = profile_begin(scope)
+#define PROFILE_BEGIN(var, scope) ProfileTimer var = profile_begin(scope)
+#define PROFILE_END(var) profile_end(&(var))
+
+#else
+
+#define PROFILE_SCOPE(scope) do { } while (0)
+#define PROFILE_BEGIN(var, scope) do { } while (0)
+#define PROFILE_END(var) do { } while (0)
+
+#endif
+
+#endif
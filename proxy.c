@@ -0,0 +1,449 @@
+#include "proxy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    typedef int socklen_t;
+    typedef SOCKET proxy_socket;
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <arpa/inet.h>
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #define INVALID_SOCKET -1
+    #define closesocket close
+    typedef int proxy_socket;
+#endif
+
+#define PROXY_MAX_DATAGRAM 8192
+
+extern long long current_time_ms();
+
+enum { DIR_UP = 0, DIR_DOWN = 1 }; // joiner -> host, host -> joiner
+static const char *DIR_NAMES[] = {"up", "down"};
+
+typedef struct {
+    unsigned long long packets;     // arrived at the proxy
+    unsigned long long bytes;
+    unsigned long long lost;        // dropped by the loss setting
+    unsigned long long overflow;    // tail-dropped by the bandwidth queue
+    unsigned long long duplicated;
+    unsigned long long reordered;
+    unsigned long long frames;      // reliable data frames
+    unsigned long long retransmits; // frames whose sequence number already passed
+} DirStats;
+
+// Reliability lanes as network.c tells them apart ("channel:" header)
+#define PROXY_LANES 3
+
+typedef struct {
+    bool used;
+    struct sockaddr_in client;
+    proxy_socket upstream; // our socket towards the host for this joiner
+    double busy_until[2];  // when each direction's bandwidth queue drains
+} Flow;
+
+// One session seen on a flow. An address can carry many (a loadgen, or a
+// rematch), each numbering its frames from 1, so sequence numbers and turns
+// are followed per session.
+typedef struct {
+    const Flow *flow;      // NULL: never used
+    unsigned int session_id;
+    long long last_ms;     // last datagram seen, for reuse after PROXY_SESSION_IDLE_MS
+    int highest_seq[2][PROXY_LANES];
+    long long announce_ms; // first ATTACK_ANNOUNCE of the turn in progress, 0: none
+    int confirmed;         // bit per direction that has sent CALCULATION_CONFIRM since
+} FlowSession;
+
+// A datagram held back until release_ms; kept sorted by release time, FIFO
+// among equals
+typedef struct Delayed {
+    long long release_ms;
+    proxy_socket sock;
+    struct sockaddr_in to;
+    int len;
+    struct Delayed *next;
+    char data[];
+} Delayed;
+
+typedef struct {
+    ProxyConfig cfg;
+    proxy_socket listen_sock;
+    struct sockaddr_in target;
+    Flow flows[PROXY_MAX_FLOWS];
+    FlowSession sessions[PROXY_MAX_SESSIONS]; // open addressing on (flow, session_id)
+    Delayed *queue;
+    unsigned int rng;
+    DirStats dir[2];
+    // Turn completion times, for percentiles
+    int *turn_ms;
+    size_t turn_count, turn_cap;
+} Proxy;
+
+void proxy_default_config(ProxyConfig *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->queue_ms = PROXY_QUEUE_MS;
+    cfg->reorder_ms = 50;
+    cfg->seed = 1;
+}
+
+bool proxy_parse_option(ProxyConfig *cfg, const char *arg) {
+    const char *eq = strchr(arg, '=');
+    if (!eq) return false;
+    size_t klen = (size_t)(eq - arg);
+    const char *v = eq + 1;
+#define KEY(k) (klen == strlen(k) && strncmp(arg, k, klen) == 0)
+    if (KEY("loss")) cfg->loss = atof(v);
+    else if (KEY("dup")) cfg->duplicate = atof(v);
+    else if (KEY("reorder")) cfg->reorder = atof(v);
+    else if (KEY("latency")) cfg->latency_ms = atoi(v);
+    else if (KEY("jitter")) cfg->jitter_ms = atoi(v);
+    else if (KEY("reorder_ms")) cfg->reorder_ms = atoi(v);
+    else if (KEY("rate")) cfg->rate_kbps = atoi(v);
+    else if (KEY("queue")) cfg->queue_ms = atoi(v);
+    else if (KEY("seed")) cfg->seed = (unsigned int)strtoul(v, NULL, 10);
+    else if (KEY("duration")) cfg->duration_s = atoi(v);
+    else return false;
+#undef KEY
+    return true;
+}
+
+// --- Impairments ---
+static unsigned int next_rand(Proxy *p) {
+    unsigned int x = p->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return p->rng = x;
+}
+
+static bool chance(Proxy *p, double prob) {
+    return prob > 0 && (next_rand(p) / 4294967296.0) < prob;
+}
+
+static void hold(Proxy *p, proxy_socket sock, const struct sockaddr_in *to, const char *data, int len, long long at) {
+    Delayed *d = malloc(sizeof(Delayed) + (size_t)len);
+    if (!d) return;
+    d->release_ms = at;
+    d->sock = sock;
+    d->to = *to;
+    d->len = len;
+    memcpy(d->data, data, (size_t)len);
+    Delayed **link = &p->queue;
+    while (*link && (*link)->release_ms <= at) link = &(*link)->next;
+    d->next = *link;
+    *link = d;
+}
+
+// Bandwidth queue first (tail drop past queue_ms of backlog), then the
+// one-way delay; a reordered copy waits reorder_ms longer
+static void impair(Proxy *p, Flow *f, int dir, proxy_socket sock, const struct sockaddr_in *to,
+                   const char *data, int len, long long now) {
+    DirStats *st = &p->dir[dir];
+    if (chance(p, p->cfg.loss)) {
+        st->lost++;
+        return;
+    }
+    int copies = 1;
+    if (chance(p, p->cfg.duplicate)) {
+        copies = 2;
+        st->duplicated++;
+    }
+    for (int c = 0; c < copies; c++) {
+        double sent = (double)now;
+        if (p->cfg.rate_kbps > 0) {
+            double start = f->busy_until[dir] > now ? f->busy_until[dir] : (double)now;
+            if (start - now > p->cfg.queue_ms) {
+                st->overflow++;
+                continue;
+            }
+            f->busy_until[dir] = start + len * 8.0 / p->cfg.rate_kbps; // kbit/s = bits per ms
+            sent = f->busy_until[dir];
+        }
+        long long at = (long long)sent + p->cfg.latency_ms;
+        if (p->cfg.jitter_ms > 0) at += next_rand(p) % (unsigned int)(p->cfg.jitter_ms + 1);
+        if (chance(p, p->cfg.reorder)) {
+            at += p->cfg.reorder_ms;
+            st->reordered++;
+        }
+        hold(p, sock, to, data, len, at);
+    }
+}
+
+static long long release_due(Proxy *p, long long now) {
+    while (p->queue && p->queue->release_ms <= now) {
+        Delayed *d = p->queue;
+        p->queue = d->next;
+        sendto(d->sock, d->data, d->len, 0, (struct sockaddr *)&d->to, sizeof(d->to));
+        free(d);
+    }
+    return p->queue ? p->queue->release_ms : -1;
+}
+
+// --- Watching the protocol ---
+// Value of "key: " within one frame, like network.c's frame_header()
+static const char *frame_value(const char *frame, const char *end, const char *key) {
+    size_t klen = strlen(key);
+    for (const char *line = frame; line && line < end; ) {
+        if (strncmp(line, key, klen) == 0 && line[klen] == ':')
+            return line + klen + (line[klen + 1] == ' ' ? 2 : 1);
+        if (strncmp(line, "message_text:", 13) == 0 || strncmp(line, "sticker_data:", 13) == 0) break;
+        line = memchr(line, '\n', (size_t)(end - line));
+        if (line) line++;
+    }
+    return NULL;
+}
+
+static int frame_lane(const char *frame, const char *end) {
+    const char *ch = frame_value(frame, end, "channel");
+    if (ch && strncmp(ch, "chat", 4) == 0) return 1;
+    if (ch && strncmp(ch, "bulk", 4) == 0) return 2;
+    return 0;
+}
+
+static void record_turn(Proxy *p, int ms) {
+    if (p->turn_count == p->turn_cap) {
+        size_t cap = p->turn_cap ? p->turn_cap * 2 : 256;
+        int *grown = realloc(p->turn_ms, cap * sizeof(int));
+        if (!grown) return;
+        p->turn_ms = grown;
+        p->turn_cap = cap;
+    }
+    p->turn_ms[p->turn_count++] = ms;
+}
+
+// The session a datagram belongs to, found or taken. Slots are never
+// emptied, only reused once idle, so a lookup can stop at the first unused
+// one. NULL when every slot on the way is busy.
+static FlowSession *session_for(Proxy *p, const Flow *f, unsigned int id, long long now) {
+    unsigned int home = (id ^ (unsigned int)(f - p->flows) * 2654435761u) & (PROXY_MAX_SESSIONS - 1);
+    FlowSession *idle = NULL;
+    for (unsigned int n = 0; n < PROXY_MAX_SESSIONS; n++) {
+        FlowSession *fs = &p->sessions[(home + n) & (PROXY_MAX_SESSIONS - 1)];
+        if (fs->flow == f && fs->session_id == id) {
+            fs->last_ms = now;
+            return fs;
+        }
+        if (!fs->flow || now - fs->last_ms > PROXY_SESSION_IDLE_MS) {
+            if (!idle) idle = fs;
+            if (!fs->flow) break;
+        }
+    }
+    if (!idle) return NULL;
+    memset(idle, 0, sizeof(*idle));
+    idle->flow = f;
+    idle->session_id = id;
+    idle->last_ms = now;
+    return idle;
+}
+
+// Looks at each frame as the sender sent it, before any impairment
+static void observe(Proxy *p, Flow *f, int dir, char *data, int len, long long now) {
+    DirStats *st = &p->dir[dir];
+    data[len] = '\0';
+    // The first line names the session; peers that have none yet send 0
+    unsigned int id = strncmp(data, "session_id: ", 12) == 0 ? (unsigned int)strtoul(data + 12, NULL, 10) : 0;
+    FlowSession *fs = session_for(p, f, id, now);
+    for (char *frame = data; frame && *frame; ) {
+        char *next = strstr(frame, "\n\n");
+        char *end = next ? next + 1 : data + len;
+        const char *seq = frame_value(frame, end, "sequence_number");
+        if (seq && strncmp(frame, "event_seq:", 10) != 0) {
+            st->frames++;
+            int lane = frame_lane(frame, end);
+            int n = atoi(seq);
+            if (!fs) {
+                // No slot to follow this session in: counted, not judged
+            } else if (n <= fs->highest_seq[dir][lane]) {
+                st->retransmits++;
+            } else {
+                fs->highest_seq[dir][lane] = n;
+                const char *type = frame_value(frame, end, "message_type");
+                if (type && strncmp(type, "ATTACK_ANNOUNCE", 15) == 0 && fs->announce_ms == 0) {
+                    fs->announce_ms = now;
+                    fs->confirmed = 0;
+                } else if (type && strncmp(type, "CALCULATION_CONFIRM", 19) == 0 && fs->announce_ms != 0) {
+                    fs->confirmed |= 1 << dir;
+                    if (fs->confirmed == 3) {
+                        record_turn(p, (int)(now - fs->announce_ms));
+                        fs->announce_ms = 0;
+                    }
+                }
+            }
+        }
+        frame = next ? next + 2 : NULL;
+    }
+}
+
+// --- Flows ---
+static void set_nonblocking(proxy_socket s) {
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(s, FIONBIO, &mode);
+#else
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+static Flow *flow_for(Proxy *p, const struct sockaddr_in *client) {
+    Flow *free_slot = NULL;
+    for (int i = 0; i < PROXY_MAX_FLOWS; i++) {
+        Flow *f = &p->flows[i];
+        if (!f->used) {
+            if (!free_slot) free_slot = f;
+            continue;
+        }
+        if (f->client.sin_addr.s_addr == client->sin_addr.s_addr && f->client.sin_port == client->sin_port) return f;
+    }
+    if (!free_slot) return NULL;
+    proxy_socket s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s == INVALID_SOCKET) return NULL;
+    set_nonblocking(s);
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->used = true;
+    free_slot->client = *client;
+    free_slot->upstream = s;
+    printf("[PROXY] New flow from %s:%d\n", inet_ntoa(client->sin_addr), ntohs(client->sin_port));
+    return free_slot;
+}
+
+// --- Reporting ---
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_stats(Proxy *p, const char *when) {
+    for (int d = 0; d < 2; d++) {
+        DirStats *st = &p->dir[d];
+        printf("[PROXY] %s %-4s %llu pkts %llu KB | lost %llu, queue drops %llu, dup %llu, reordered %llu | "
+               "%llu frames, %llu retransmitted (%.1f%%)\n",
+               when, DIR_NAMES[d], st->packets, st->bytes / 1024, st->lost, st->overflow, st->duplicated,
+               st->reordered, st->frames, st->retransmits, st->frames ? 100.0 * st->retransmits / st->frames : 0.0);
+    }
+    if (p->turn_count == 0) {
+        printf("[PROXY] %s turns: none completed\n", when);
+        return;
+    }
+    int *sorted = malloc(p->turn_count * sizeof(int));
+    if (!sorted) return;
+    memcpy(sorted, p->turn_ms, p->turn_count * sizeof(int));
+    qsort(sorted, p->turn_count, sizeof(int), compare_int);
+    printf("[PROXY] %s turns: %zu completed, p50 %d ms, p90 %d ms, p99 %d ms, max %d ms\n", when, p->turn_count,
+           sorted[p->turn_count / 2], sorted[p->turn_count * 90 / 100], sorted[p->turn_count * 99 / 100],
+           sorted[p->turn_count - 1]);
+    free(sorted);
+}
+
+// --- Main Loop ---
+int run_proxy(int listen_port, const char *target_ip, int target_port, const ProxyConfig *cfg) {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    Proxy *p = calloc(1, sizeof(Proxy));
+    if (!p) return 1;
+    p->cfg = *cfg;
+    p->rng = cfg->seed ? cfg->seed : 1;
+    p->target.sin_family = AF_INET;
+    p->target.sin_port = htons(target_port);
+    inet_pton(AF_INET, target_ip, &p->target.sin_addr);
+
+    p->listen_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(listen_port);
+    if (p->listen_sock == INVALID_SOCKET || bind(p->listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Bind failed");
+        free(p);
+        return 1;
+    }
+    set_nonblocking(p->listen_sock);
+    printf("[PROXY] %d -> %s:%d | loss %.1f%%, dup %.1f%%, reorder %.1f%% (+%d ms) | latency %d ms + 0..%d ms jitter\n",
+           listen_port, target_ip, target_port, cfg->loss * 100, cfg->duplicate * 100, cfg->reorder * 100,
+           cfg->reorder_ms, cfg->latency_ms, cfg->jitter_ms);
+    if (cfg->rate_kbps) printf("[PROXY] Rate %d kbit/s per direction, %d ms queue\n", cfg->rate_kbps, cfg->queue_ms);
+
+    long long start = current_time_ms();
+    long long next_report = start + PROXY_REPORT_MS;
+    long long stop = cfg->duration_s > 0 ? start + cfg->duration_s * 1000LL : -1;
+    char buf[PROXY_MAX_DATAGRAM + 1];
+
+    for (;;) {
+        long long now = current_time_ms();
+        if (stop >= 0 && now >= stop) break;
+        long long next = release_due(p, now);
+
+        // Sleep until a datagram arrives or the next release/report is due
+        long long wake = next_report;
+        if (next >= 0 && next < wake) wake = next;
+        if (stop >= 0 && stop < wake) wake = stop;
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(p->listen_sock, &fds);
+        int maxfd = (int)p->listen_sock;
+        for (int i = 0; i < PROXY_MAX_FLOWS; i++) {
+            if (!p->flows[i].used) continue;
+            FD_SET(p->flows[i].upstream, &fds);
+            if ((int)p->flows[i].upstream > maxfd) maxfd = (int)p->flows[i].upstream;
+        }
+        long long wait_ms = wake - now;
+        if (wait_ms < 0) wait_ms = 0;
+        struct timeval tv = {(long)(wait_ms / 1000), (long)(wait_ms % 1000) * 1000};
+        int ready = select(maxfd + 1, &fds, NULL, NULL, &tv);
+        now = current_time_ms();
+
+        if (ready > 0 && FD_ISSET(p->listen_sock, &fds)) {
+            struct sockaddr_in from;
+            socklen_t flen = sizeof(from);
+            int n;
+            while ((n = recvfrom(p->listen_sock, buf, PROXY_MAX_DATAGRAM, 0, (struct sockaddr *)&from, &flen)) > 0) {
+                Flow *f = flow_for(p, &from);
+                flen = sizeof(from);
+                if (!f) continue;
+                p->dir[DIR_UP].packets++;
+                p->dir[DIR_UP].bytes += (unsigned long long)n;
+                observe(p, f, DIR_UP, buf, n, now);
+                impair(p, f, DIR_UP, f->upstream, &p->target, buf, n, now);
+            }
+        }
+        for (int i = 0; ready > 0 && i < PROXY_MAX_FLOWS; i++) {
+            Flow *f = &p->flows[i];
+            if (!f->used || !FD_ISSET(f->upstream, &fds)) continue;
+            int n;
+            while ((n = recvfrom(f->upstream, buf, PROXY_MAX_DATAGRAM, 0, NULL, NULL)) > 0) {
+                p->dir[DIR_DOWN].packets++;
+                p->dir[DIR_DOWN].bytes += (unsigned long long)n;
+                observe(p, f, DIR_DOWN, buf, n, now);
+                impair(p, f, DIR_DOWN, p->listen_sock, &f->client, buf, n, now);
+            }
+        }
+
+        if (now >= next_report) {
+            print_stats(p, "so far");
+            next_report = now + PROXY_REPORT_MS;
+            fflush(stdout);
+        }
+    }
+
+    print_stats(p, "total");
+    while (p->queue) {
+        Delayed *d = p->queue;
+        p->queue = d->next;
+        free(d);
+    }
+    for (int i = 0; i < PROXY_MAX_FLOWS; i++)
+        if (p->flows[i].used) closesocket(p->flows[i].upstream);
+    closesocket(p->listen_sock);
+    free(p->turn_ms);
+    free(p);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
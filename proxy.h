@@ -0,0 +1,41 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <stdbool.h>
+
+// UDP impairment proxy: joiners connect to the proxy's port instead of the
+// host's, and every datagram in either direction passes a bandwidth queue,
+// latency/jitter and random loss, duplication and reordering. Each joiner
+// address gets its own upstream socket, so the host still sees one peer per
+// joiner. The proxy also reads the protocol as it passes: it counts
+// retransmitted frames per direction and times each turn from the first
+// ATTACK_ANNOUNCE to the second side's CALCULATION_CONFIRM, following each
+// session on an address (its session_id line) separately.
+
+#define PROXY_MAX_FLOWS 256
+#define PROXY_MAX_SESSIONS 4096     // followed at once across all flows; a power of two
+#define PROXY_SESSION_IDLE_MS 30000 // a session unseen this long gives up its slot
+#define PROXY_REPORT_MS 5000
+#define PROXY_QUEUE_MS 500  // default backlog a bandwidth cap may build before tail drops
+
+typedef struct {
+    double loss;       // chance a datagram is dropped
+    double duplicate;  // chance it is sent twice
+    double reorder;    // chance it is held back reorder_ms past later ones
+    int latency_ms;    // one-way, each direction
+    int jitter_ms;     // plus 0..jitter_ms
+    int reorder_ms;
+    int rate_kbps;     // per flow and direction; 0: unlimited
+    int queue_ms;      // see PROXY_QUEUE_MS
+    unsigned int seed;
+    int duration_s;    // 0: until killed
+} ProxyConfig;
+
+void proxy_default_config(ProxyConfig *cfg);
+// Applies one "key=value" argument (loss=0.05, dup=, reorder=, latency=,
+// jitter=, reorder_ms=, rate=<kbit/s>, queue=<ms>, seed=, duration=<s>)
+bool proxy_parse_option(ProxyConfig *cfg, const char *arg);
+
+int run_proxy(int listen_port, const char *target_ip, int target_port, const ProxyConfig *cfg);
+
+#endif
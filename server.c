@@ -0,0 +1,206 @@
+#include "server.h"
+#include "network.h"
+#include "game_logic.h"
+#include "damage_calc.h"
+#include "journal.h"
+#include "metrics.h"
+#include "profile.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/socket.h> // SO_REUSEPORT
+#endif
+
+typedef struct
+{
+    int index;
+    NetWorker *net;
+    const char *pokemon_name;
+    const char *move;
+    long long battles_started;
+    long long battles_finished;
+    long long battles_timed_out;
+    TimerNode stats_timer;
+    TimerNode metrics_timer; // worker 0 only: the metrics are process-wide
+} ServerWorker;
+
+// The server's side always opens with its first ability
+static const char *server_pick_move(const char *pokemon_name)
+{
+    const PokemonData *p = get_pokemon(pokemon_name);
+    if (p && p->ability_count > 0)
+        return p->abilities[0];
+    return MOVE_COUNT > 0 ? MOVE_DB[0].name : "Tackle";
+}
+
+static void print_worker_stats(TimerNode *t, void *arg)
+{
+    ServerWorker *sw = (ServerWorker *)arg;
+    NetIoStats io = net_get_io_stats();
+    ResolutionStats rs = get_resolution_stats(); // process-wide
+    LOG_INFO("[SERVER %d] Sessions: %d | Started: %lld | Finished: %lld | Timed out: %lld | Resolutions: %llu/%llu | Memory: %zu KB | rx %llu pkts/%llu calls | tx %llu pkts/%llu calls\n",
+             sw->index, net_session_count(), sw->battles_started, sw->battles_finished, sw->battles_timed_out,
+             rs.resolved, rs.requested, net_memory_bytes() / 1024, io.rx_packets, io.rx_syscalls, io.tx_packets, io.tx_syscalls);
+    net_timer_arm(t, SERVER_STATS_INTERVAL_MS);
+}
+
+static void print_metrics(TimerNode *t, void *arg)
+{
+    (void)arg;
+    metrics_print_line("[METRICS]");
+    net_timer_arm(t, METRICS_DUMP_MS);
+}
+
+// A (re)started battle gets a fresh journal, charged to its session so the
+// session's memory budget covers the buffers it can hold
+static void start_battle(NetSession *s, BattleContext *ctx, const char *pokemon_name)
+{
+    net_session_charge_memory(s, -(long)journal_memory_bytes(ctx->journal));
+    journal_close(ctx->journal);
+    init_battle_state(ctx, ROLE_HOST, pokemon_name);
+    ctx->journal = journal_create(net_session_id(s), SERVER_JOURNAL_BUFFER_BYTES, SERVER_JOURNAL_BUFFERS);
+    net_session_charge_memory(s, (long)journal_memory_bytes(ctx->journal));
+    journal_record_begin(ctx->journal, ROLE_HOST, pokemon_name);
+}
+
+// A client that stops playing forfeits its session
+static void on_turn_timeout(NetSession *s, void *arg)
+{
+    ServerWorker *sw = (ServerWorker *)arg;
+    BattleContext *ctx = net_session_battle(s);
+    if (ctx->state == STATE_GAME_OVER)
+        return;
+    ctx->state = STATE_GAME_OVER;
+    net_session_close(s);
+    sw->battles_timed_out++;
+}
+
+// One worker's event loop. It only touches its own NetWorker and the
+// sessions in it; the Pokémon/move databases are read-only by now.
+static void *server_worker_loop(void *arg)
+{
+    ServerWorker *sw = (ServerWorker *)arg;
+    net_worker_select(sw->net);
+
+    GameMessage msg;
+    net_set_turn_timeout_handler(on_turn_timeout, sw);
+    timer_init(&sw->stats_timer, print_worker_stats, sw);
+    net_timer_arm(&sw->stats_timer, SERVER_STATS_INTERVAL_MS);
+    if (sw->index == 0)
+    {
+        timer_init(&sw->metrics_timer, print_metrics, sw);
+        net_timer_arm(&sw->metrics_timer, METRICS_DUMP_MS);
+    }
+
+    for (;;)
+    {
+        PROFILE_BEGIN(loop_timer, PROF_EVENT_LOOP);
+        while (net_process_updates(&msg))
+        {
+            NetSession *s = net_active_session();
+            BattleContext *ctx = net_session_battle(s);
+
+            if (msg.type == MSG_HANDSHAKE_REQUEST)
+            {
+                // A rematch on the same session starts a new journal
+                start_battle(s, ctx, sw->pokemon_name);
+                sw->battles_started++;
+            }
+            if (ctx->my_pokemon[0] == '\0' && msg.type != MSG_SPECTATOR_REQUEST && msg.type != MSG_SNAPSHOT_REQUEST)
+                continue; // no battle on this session (stray or spectator traffic)
+
+            BattleState before = ctx->state;
+            process_incoming_message(ctx, &msg);
+
+            if (ctx->state == STATE_WAITING_FOR_MOVE && ctx->is_my_turn)
+                execute_move_command(ctx, sw->move);
+            if (ctx->state == STATE_GAME_OVER && before != STATE_GAME_OVER)
+            {
+                net_session_close(s);
+                sw->battles_finished++;
+            }
+
+            // The client has TURN_TIMEOUT_MS for each step it owes us; every
+            // battle message it sends restarts the clock
+            bool progressed = msg.type == MSG_HANDSHAKE_REQUEST ||
+                              (msg.type >= MSG_BATTLE_SETUP && msg.type <= MSG_GAME_OVER);
+            if (!battle_awaiting_opponent(ctx))
+                net_session_cancel_turn_timer(s);
+            else if (progressed || !net_session_turn_timer_armed(s))
+                net_session_arm_turn_timer(s, TURN_TIMEOUT_MS);
+        }
+        PROFILE_END(loop_timer);
+
+        // Sleeps until the next datagram or timer (retry, ACK, keepalive,
+        // eviction, turn timeout, stats)
+        net_wait(-1);
+    }
+    return NULL;
+}
+
+int run_server(int port, const char *pokemon_name, int max_sessions, int workers)
+{
+    if (max_sessions <= 0)
+        max_sessions = SERVER_DEFAULT_MAX_SESSIONS;
+#if defined(_WIN32) || !defined(SO_REUSEPORT)
+    workers = 1; // no SO_REUSEPORT sharding here
+#endif
+    if (workers <= 0)
+        workers = 1;
+    if (workers > SERVER_MAX_WORKERS)
+        workers = SERVER_MAX_WORKERS;
+
+    load_all_pokemon_and_moves("pokemon.csv");
+    if (!get_pokemon(pokemon_name))
+    {
+        printf("[SERVER] Unknown Pokémon %s, using %s\n", pokemon_name, POKEMON_DB[0].name);
+        pokemon_name = POKEMON_DB[0].name;
+    }
+    const char *move = server_pick_move(pokemon_name);
+
+    // Each worker gets its own socket on the shared port and its own slice of
+    // the session budget
+    ServerWorker pool[SERVER_MAX_WORKERS];
+    int per_worker = (max_sessions + workers - 1) / workers;
+    memset(pool, 0, sizeof(pool));
+    for (int i = 0; i < workers; i++)
+    {
+        pool[i].index = i;
+        pool[i].pokemon_name = pokemon_name;
+        pool[i].move = move;
+        pool[i].net = net_worker_create(port, per_worker, true, workers > 1);
+        if (!pool[i].net)
+        {
+            printf("[SERVER] Could not open worker %d on port %d\n", i, port);
+            return 1;
+        }
+    }
+    // Spectators land on whichever worker their address hashes to; the
+    // workers hand them to the one holding their battle
+    for (int i = 0; i < workers && workers > 1; i++)
+    {
+        if (!net_worker_share_battles(pool[i].net, per_worker * workers))
+        {
+            printf("[SERVER] Worker %d can't share battles; spectators only see battles on their own worker\n", i);
+            break;
+        }
+    }
+    net_worker_select(pool[0].net);
+    // Battle logs go through the background writer from here on
+    log_start_async();
+    printf("[NET] Listening on port %d (%s transport)\n", port, net_transport_name());
+    printf("[SERVER] Hosting up to %d battles on %d worker(s) as %s (%s)\n",
+           per_worker * workers, workers, pokemon_name, move);
+
+#ifndef _WIN32
+    pthread_t threads[SERVER_MAX_WORKERS];
+    for (int i = 1; i < workers; i++)
+        pthread_create(&threads[i], NULL, server_worker_loop, &pool[i]);
+#endif
+    server_worker_loop(&pool[0]);
+    return 0;
+}
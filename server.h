@@ -0,0 +1,15 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#define SERVER_DEFAULT_MAX_SESSIONS 4096
+#define SERVER_STATS_INTERVAL_MS 5000
+#define SERVER_MAX_WORKERS 64
+#define SERVER_JOURNAL_BUFFER_BYTES (8 * 1024) // per buffer
+#define SERVER_JOURNAL_BUFFERS 2               // per battle: a quarter of NET_SESSION_MEM_LIMIT, charged to it
+
+// Multi-battle host. Every joiner gets its own session and BattleContext; the
+// server plays its side with pokemon_name automatically. With workers > 1
+// each worker thread owns an SO_REUSEPORT socket and its shard of sessions.
+int run_server(int port, const char *pokemon_name, int max_sessions, int workers);
+
+#endif
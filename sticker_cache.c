@@ -0,0 +1,173 @@
+#include "sticker_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #define make_dir(p) _mkdir(p)
+#else
+    #include <sys/stat.h>
+    #define make_dir(p) mkdir(p, 0755)
+#endif
+
+#define FNV_PRIME 1099511628211ULL
+#define INDEX_PATH STICKER_CACHE_DIR "/index.txt"
+
+typedef struct {
+    StickerHash hash;
+    long size;
+    unsigned long long last_used; // higher = more recent
+} CacheEntry;
+
+// --- Index ---
+static CacheEntry entries[STICKER_CACHE_MAX_ENTRIES];
+static int entry_count = 0;
+static long total_bytes = 0;
+static unsigned long long use_clock = 0;
+static bool loaded = false;
+
+static void entry_path(StickerHash hash, char *path, size_t path_len) {
+    char hex[17];
+    sticker_hash_format(hash, hex);
+    snprintf(path, path_len, "%s/%s", STICKER_CACHE_DIR, hex);
+}
+
+static void save_index(void) {
+    FILE *fp = fopen(INDEX_PATH ".tmp", "w");
+    if (!fp) return;
+    for (int i = 0; i < entry_count; i++) {
+        char hex[17];
+        sticker_hash_format(entries[i].hash, hex);
+        fprintf(fp, "%s %ld %llu\n", hex, entries[i].size, entries[i].last_used);
+    }
+    fclose(fp);
+    remove(INDEX_PATH); // rename() won't replace on Windows
+    rename(INDEX_PATH ".tmp", INDEX_PATH);
+}
+
+// Reads the index once; entries whose file has gone are dropped
+static void load_index(void) {
+    if (loaded) return;
+    loaded = true;
+    make_dir(STICKER_CACHE_DIR);
+
+    FILE *fp = fopen(INDEX_PATH, "r");
+    if (!fp) return;
+    char line[96], hex[32];
+    while (fgets(line, sizeof(line), fp) && entry_count < STICKER_CACHE_MAX_ENTRIES) {
+        CacheEntry e;
+        if (sscanf(line, "%31s %ld %llu", hex, &e.size, &e.last_used) != 3) continue;
+        if (!sticker_hash_parse(hex, &e.hash)) continue;
+        char path[128];
+        entry_path(e.hash, path, sizeof(path));
+        FILE *f = fopen(path, "rb");
+        if (!f) continue;
+        fclose(f);
+        entries[entry_count++] = e;
+        total_bytes += e.size;
+        if (e.last_used > use_clock) use_clock = e.last_used;
+    }
+    fclose(fp);
+}
+
+static int find_entry(StickerHash hash) {
+    for (int i = 0; i < entry_count; i++)
+        if (entries[i].hash == hash) return i;
+    return -1;
+}
+
+static void evict_lru(void) {
+    int lru = 0;
+    for (int i = 1; i < entry_count; i++)
+        if (entries[i].last_used < entries[lru].last_used) lru = i;
+    char path[128];
+    entry_path(entries[lru].hash, path, sizeof(path));
+    remove(path);
+    total_bytes -= entries[lru].size;
+    entries[lru] = entries[--entry_count];
+}
+
+// --- Hashing ---
+StickerHash sticker_hash_update(StickerHash hash, const void *data, size_t n) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < n; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+void sticker_hash_format(StickerHash hash, char out[17]) {
+    snprintf(out, 17, "%016llx", hash);
+}
+
+bool sticker_hash_parse(const char *text, StickerHash *hash) {
+    char *end;
+    *hash = strtoull(text, &end, 16);
+    return end - text == 16;
+}
+
+// --- Cache ---
+bool sticker_cache_lookup(StickerHash hash, char *path, size_t path_len) {
+    load_index();
+    int i = find_entry(hash);
+    if (i < 0) return false;
+    entry_path(hash, path, path_len);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        // Deleted behind our back
+        total_bytes -= entries[i].size;
+        entries[i] = entries[--entry_count];
+        save_index();
+        return false;
+    }
+    fclose(f);
+    entries[i].last_used = ++use_clock;
+    save_index();
+    return true;
+}
+
+void sticker_cache_partial_path(StickerHash hash, unsigned int transfer_id, char *path, size_t path_len) {
+    char hex[17];
+    load_index();
+    sticker_hash_format(hash, hex);
+    snprintf(path, path_len, "%s/%s-%u.part", STICKER_CACHE_DIR, hex, transfer_id);
+}
+
+bool sticker_cache_commit(StickerHash hash, StickerHash actual, const char *partial_path, char *path, size_t path_len) {
+    load_index();
+    FILE *fp = actual == hash ? fopen(partial_path, "rb") : NULL;
+    if (!fp) {
+        remove(partial_path);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+
+    entry_path(hash, path, path_len);
+    int i = find_entry(hash);
+    if (i >= 0) {
+        // Another transfer of the same sticker finished first
+        remove(partial_path);
+        entries[i].last_used = ++use_clock;
+        save_index();
+        return true;
+    }
+
+    while (entry_count > 0 && (entry_count >= STICKER_CACHE_MAX_ENTRIES || total_bytes + size > STICKER_CACHE_MAX_BYTES))
+        evict_lru();
+    remove(path);
+    if (rename(partial_path, path) != 0) {
+        remove(partial_path);
+        return false;
+    }
+    entries[entry_count].hash = hash;
+    entries[entry_count].size = size;
+    entries[entry_count].last_used = ++use_clock;
+    entry_count++;
+    total_bytes += size;
+    save_index();
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef STICKER_CACHE_H
+#define STICKER_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Content-addressed sticker store: files live in STICKER_CACHE_DIR named by
+// their hash, with an index recording size and recency for LRU eviction.
+
+#define STICKER_CACHE_DIR "sticker_cache"
+#define STICKER_CACHE_MAX_BYTES (64L * 1024 * 1024)
+#define STICKER_CACHE_MAX_ENTRIES 256
+
+typedef unsigned long long StickerHash; // FNV-1a 64 of the file bytes
+#define STICKER_HASH_INIT 1469598103934665603ULL
+
+// Hashes can be built a piece at a time so big files don't stall the loop
+StickerHash sticker_hash_update(StickerHash hash, const void *data, size_t n);
+void sticker_hash_format(StickerHash hash, char out[17]);
+bool sticker_hash_parse(const char *text, StickerHash *hash);
+
+// Fills path and marks the entry most recently used; false on a miss
+bool sticker_cache_lookup(StickerHash hash, char *path, size_t path_len);
+// Where an incoming transfer should write its bytes
+void sticker_cache_partial_path(StickerHash hash, unsigned int transfer_id, char *path, size_t path_len);
+// Checks a finished download (actual = hash of what arrived) against the
+// offered hash and moves it into the cache, evicting least recently used
+// entries past the limits; fills path
+bool sticker_cache_commit(StickerHash hash, StickerHash actual, const char *partial_path, char *path, size_t path_len);
+
+#endif
@@ -0,0 +1,136 @@
+#include "timer_wheel.h"
+#include <stddef.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(l) ((l) * TIMER_WHEEL_BITS)
+
+static void list_insert(TimerNode *head, TimerNode *t) {
+    t->next = head->next;
+    t->prev = head;
+    head->next->prev = t;
+    head->next = t;
+}
+
+static void list_unlink(TimerNode *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+void timer_wheel_init(TimerWheel *w, long long now) {
+    w->now = now;
+    w->count = 0;
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+            TimerNode *head = &w->slots[l][i];
+            head->next = head->prev = head;
+        }
+    }
+}
+
+void timer_init(TimerNode *t, TimerCallback callback, void *arg) {
+    t->next = t->prev = NULL;
+    t->expires = 0;
+    t->callback = callback;
+    t->arg = arg;
+}
+
+bool timer_pending(const TimerNode *t) {
+    return t->prev != NULL;
+}
+
+// Files t at the finest level whose span still contains both now and the
+// deadline, so a slot is only ever reached once its span has begun
+static void place(TimerWheel *w, TimerNode *t) {
+    long long at = t->expires;
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        if ((at >> LEVEL_SHIFT(l + 1)) == (w->now >> LEVEL_SHIFT(l + 1))) {
+            list_insert(&w->slots[l][(at >> LEVEL_SHIFT(l)) & SLOT_MASK], t);
+            return;
+        }
+    }
+    // Beyond the top level: park in the next top slot to be cascaded, which
+    // re-files it (or parks it again) once that slot's span begins
+    int top = TIMER_WHEEL_LEVELS - 1;
+    list_insert(&w->slots[top][((w->now >> LEVEL_SHIFT(top)) + 1) & SLOT_MASK], t);
+}
+
+void timer_arm(TimerWheel *w, TimerNode *t, long long expires) {
+    if (timer_pending(t)) list_unlink(t);
+    else w->count++;
+    t->expires = expires > w->now ? expires : w->now + 1;
+    place(w, t);
+}
+
+void timer_cancel(TimerWheel *w, TimerNode *t) {
+    if (!timer_pending(t)) return;
+    list_unlink(t);
+    w->count--;
+}
+
+// Re-files everything in one coarse slot now that its span has started
+static void cascade(TimerWheel *w, int level, int slot) {
+    TimerNode *head = &w->slots[level][slot];
+    TimerNode pending;
+    if (head->next == head) return;
+    // Detach the list first: place() may put entries back into this slot
+    pending.next = head->next;
+    pending.prev = head->prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    head->next = head->prev = head;
+    while (pending.next != &pending) {
+        TimerNode *t = pending.next;
+        list_unlink(t);
+        place(w, t);
+    }
+}
+
+int timer_wheel_advance(TimerWheel *w, long long now) {
+    int fired = 0;
+    if (w->count == 0) {
+        if (now > w->now) w->now = now;
+        return 0;
+    }
+    while (w->now < now) {
+        // Skip empty stretches; the next deadline is never past a cascade
+        // point that still holds timers
+        long long next = timer_wheel_next_deadline(w);
+        if (next > w->now + 1) w->now = (next - 1 < now ? next - 1 : now - 1);
+        w->now++;
+        // Coarse levels first, so their entries can land in finer slots
+        for (int l = TIMER_WHEEL_LEVELS - 1; l > 0; l--) {
+            if ((w->now & ((1LL << LEVEL_SHIFT(l)) - 1)) == 0)
+                cascade(w, l, (int)((w->now >> LEVEL_SHIFT(l)) & SLOT_MASK));
+        }
+        TimerNode *head = &w->slots[0][w->now & SLOT_MASK];
+        while (head->next != head) {
+            TimerNode *t = head->next;
+            list_unlink(t);
+            w->count--;
+            fired++;
+            t->callback(t, t->arg);
+        }
+        if (w->count == 0) {
+            w->now = now;
+            break;
+        }
+    }
+    return fired;
+}
+
+long long timer_wheel_next_deadline(const TimerWheel *w) {
+    if (w->count == 0) return -1;
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        long long span_start = (w->now >> LEVEL_SHIFT(l + 1)) << LEVEL_SHIFT(l + 1);
+        int cur = (int)((w->now >> LEVEL_SHIFT(l)) & SLOT_MASK);
+        for (int i = cur + 1; i < TIMER_WHEEL_SLOTS; i++) {
+            const TimerNode *head = &w->slots[l][i];
+            if (head->next != head)
+                return span_start + ((long long)i << LEVEL_SHIFT(l));
+        }
+    }
+    // Only parked far-future timers: wake at the next top-level cascade
+    int top = TIMER_WHEEL_LEVELS - 1;
+    return ((w->now >> LEVEL_SHIFT(top)) + 1) << LEVEL_SHIFT(top);
+}
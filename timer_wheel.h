@@ -0,0 +1,44 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+
+// Hierarchical timing wheel with 1 ms ticks: TIMER_WHEEL_LEVELS levels of
+// TIMER_WHEEL_SLOTS slots each (64 ms, 4 s, 4.4 min, 4.7 h). Arming and
+// cancelling are O(1); a timer is re-filed into a finer level at most once
+// per level on its way to expiring.
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+typedef struct TimerNode TimerNode;
+typedef void (*TimerCallback)(TimerNode *timer, void *arg);
+
+// Embedded in whatever owns the deadline; must not move while armed
+struct TimerNode {
+    TimerNode *next;
+    TimerNode *prev;     // NULL while not armed
+    long long expires;   // ms, same clock as timer_wheel_advance()
+    TimerCallback callback;
+    void *arg;
+};
+
+typedef struct {
+    long long now;       // last tick processed
+    int count;           // armed timers
+    TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // list heads
+} TimerWheel;
+
+void timer_wheel_init(TimerWheel *w, long long now);
+void timer_init(TimerNode *t, TimerCallback callback, void *arg);
+// (Re-)arms t; deadlines in the past fire on the next tick
+void timer_arm(TimerWheel *w, TimerNode *t, long long expires);
+void timer_cancel(TimerWheel *w, TimerNode *t);
+bool timer_pending(const TimerNode *t);
+// Runs every timer due by now; callbacks may arm or cancel timers
+int timer_wheel_advance(TimerWheel *w, long long now);
+// Earliest time anything may fire (never later than the real deadline); -1 if idle
+long long timer_wheel_next_deadline(const TimerWheel *w);
+
+#endif
@@ -0,0 +1,304 @@
+#include "verify.h"
+#include "journal.h"
+#include "damage_calc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <pthread.h>
+    #include <dirent.h>
+    #include <unistd.h>
+#endif
+
+extern long long current_time_ms();
+extern void parse_kv(char *buffer, GameMessage *msg);
+
+#define VERIFY_PATH_MAX 512
+#define VERIFY_FLAG_LINE 192
+
+// --- One journal ---
+typedef struct {
+    char name[32];
+    int hp;
+} VerifySide;
+
+// The hit as recomputed from the defender's HP before it. The defender's
+// HP moves on as soon as the turn opens, so later turns build on our own
+// numbers rather than on anything either peer reported.
+typedef struct {
+    bool open;
+    unsigned int number;
+    const VerifySide *attacker;
+    const VerifySide *defender;
+    char move[32];
+    int hp_before;
+    int damage;
+    int hp_after;
+} VerifyTurn;
+
+typedef struct {
+    VerifyTotals counts; // this file only
+    char flags[VERIFY_MAX_FLAGS_PER_FILE * VERIFY_FLAG_LINE];
+    size_t flags_len;
+} FileResult;
+
+static void side_init(VerifySide *s, const char *name, int len) {
+    if (len > 31) len = 31;
+    memcpy(s->name, name, (size_t)len);
+    s->name[len] = '\0';
+    const PokemonData *p = get_pokemon(s->name);
+    s->hp = p ? p->hp : 100; // as init_battle_state() does
+}
+
+static void open_turn(VerifyTurn *t, VerifySide *attacker, VerifySide *defender, const char *move) {
+    DamageResult res = calculate_damage_logic(attacker->name, defender->name, move);
+    t->open = true;
+    t->number++;
+    t->attacker = attacker;
+    t->defender = defender;
+    strncpy(t->move, move, 31);
+    t->move[31] = '\0';
+    t->hp_before = defender->hp;
+    t->damage = res.damage_dealt;
+    t->hp_after = defender->hp - res.damage_dealt;
+    if (t->hp_after < 0) t->hp_after = 0;
+    defender->hp = t->hp_after;
+}
+
+static void flag_report(FileResult *fr, const char *file, const VerifyTurn *t, const GameMessage *msg, bool ours) {
+    fr->counts.bad_reports++;
+    if (fr->counts.bad_reports > VERIFY_MAX_FLAGS_PER_FILE) return;
+    int n = snprintf(fr->flags + fr->flags_len, sizeof(fr->flags) - fr->flags_len,
+                     "[VERIFY] %s turn %u: %s report %s %s -> %s Dmg %d HP %d, expected Dmg %d HP %d (from %d)\n",
+                     file, t->number, ours ? "our" : "peer", t->attacker->name, t->move, t->defender->name,
+                     msg->damage_dealt, msg->defender_hp_remaining, t->damage, t->hp_after, t->hp_before);
+    if (n > 0 && fr->flags_len + (size_t)n < sizeof(fr->flags)) fr->flags_len += (size_t)n;
+}
+
+static void verify_file(const char *path, const char *file, FileResult *fr) {
+    JournalReader r;
+    memset(&fr->counts, 0, sizeof(fr->counts));
+    fr->flags_len = 0;
+    fr->counts.files = 1;
+    if (!journal_reader_open(&r, path)) {
+        fr->counts.unreadable = 1;
+        return;
+    }
+
+    VerifySide me = {"", 0}, opp = {"", 0};
+    VerifyTurn turn;
+    memset(&turn, 0, sizeof(turn));
+    GameMessage msg;
+    char buf[4096];
+    JournalRecord rec;
+    while (journal_reader_next(&r, &rec)) {
+        if (rec.kind == JOURNAL_BEGIN) {
+            // A server session restarts the battle in the same file
+            if (rec.len < 1) continue;
+            if ((PlayerRole)(unsigned char)rec.data[0] == ROLE_SPECTATOR) {
+                fr->counts.spectator = 1;
+                break;
+            }
+            side_init(&me, rec.data + 1, (int)rec.len - 1);
+            opp.name[0] = '\0';
+            opp.hp = 100;
+            memset(&turn, 0, sizeof(turn));
+            continue;
+        }
+        if (rec.kind != JOURNAL_IN && rec.kind != JOURNAL_OUT) continue;
+        if (rec.type != MSG_BATTLE_SETUP && rec.type != MSG_ATTACK_ANNOUNCE &&
+            rec.type != MSG_CALCULATION_REPORT)
+            continue;
+
+        size_t n = rec.len < sizeof(buf) - 1 ? rec.len : sizeof(buf) - 1;
+        memcpy(buf, rec.data, n);
+        buf[n] = '\0';
+        memset(&msg, 0, sizeof(msg));
+        parse_kv(buf, &msg);
+        bool ours = rec.kind == JOURNAL_OUT;
+
+        switch (rec.type) {
+        case MSG_BATTLE_SETUP:
+            if (!ours && msg.attacker[0]) side_init(&opp, msg.attacker, (int)strlen(msg.attacker));
+            break;
+        case MSG_ATTACK_ANNOUNCE:
+            // Announces name only the move; whoever sent it is attacking
+            if (ours) open_turn(&turn, &me, &opp, msg.move_name);
+            else open_turn(&turn, &opp, &me, msg.move_name);
+            fr->counts.turns++;
+            break;
+        case MSG_CALCULATION_REPORT: {
+            bool by_me = strcmp(msg.attacker, me.name) == 0;
+            // A report for a turn whose announce is missing opens it, like
+            // handle_calculation_report()'s catch-up does
+            if (!turn.open || strcmp(turn.attacker->name, msg.attacker) != 0) {
+                if (by_me) open_turn(&turn, &me, &opp, msg.move_name);
+                else open_turn(&turn, &opp, &me, msg.move_name);
+                fr->counts.turns++;
+            }
+            fr->counts.reports++;
+            if (msg.damage_dealt != turn.damage || msg.defender_hp_remaining != turn.hp_after)
+                flag_report(fr, file, &turn, &msg, ours);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if (r.pos != r.size && !fr->counts.spectator) fr->counts.truncated = 1;
+    if (fr->counts.bad_reports > 0) fr->counts.flagged_files = 1;
+    journal_reader_close(&r);
+}
+
+// --- Directory walk ---
+// Names are pulled one at a time under the run lock, so a directory of any
+// size is never listed into memory.
+typedef struct {
+    const char *dir;
+#ifdef _WIN32
+    intptr_t find;
+    struct _finddata_t found;
+    bool have_found;
+#else
+    DIR *d;
+    pthread_mutex_t lock; // directory cursor, totals and stdout
+#endif
+    VerifyTotals totals;
+    long long started_ms;
+    long long progress_ms;
+} VerifyRun;
+
+static bool is_journal_name(const char *name) {
+    size_t n = strlen(name);
+    return n > 4 && strcmp(name + n - 4, ".pkj") == 0;
+}
+
+static bool dir_open(VerifyRun *run) {
+#ifdef _WIN32
+    char pattern[VERIFY_PATH_MAX];
+    snprintf(pattern, sizeof(pattern), "%s\\*.pkj", run->dir);
+    run->find = _findfirst(pattern, &run->found);
+    run->have_found = run->find != -1;
+    return true; // an empty match is just an empty directory
+#else
+    run->d = opendir(run->dir);
+    return run->d != NULL;
+#endif
+}
+
+// Caller holds the run lock
+static bool dir_next(VerifyRun *run, char *name, size_t cap) {
+#ifdef _WIN32
+    if (!run->have_found) return false;
+    snprintf(name, cap, "%s", run->found.name);
+    run->have_found = _findnext(run->find, &run->found) == 0;
+    return true;
+#else
+    struct dirent *e;
+    while ((e = readdir(run->d)) != NULL) {
+        if (!is_journal_name(e->d_name)) continue;
+        snprintf(name, cap, "%s", e->d_name);
+        return true;
+    }
+    return false;
+#endif
+}
+
+static void dir_close(VerifyRun *run) {
+#ifdef _WIN32
+    if (run->find != -1) _findclose(run->find);
+#else
+    closedir(run->d);
+#endif
+}
+
+#ifdef _WIN32
+#define run_lock(run) ((void)0)
+#define run_unlock(run) ((void)0)
+#else
+#define run_lock(run) pthread_mutex_lock(&(run)->lock)
+#define run_unlock(run) pthread_mutex_unlock(&(run)->lock)
+#endif
+
+static void add_totals(VerifyTotals *into, const VerifyTotals *from) {
+    into->files += from->files;
+    into->unreadable += from->unreadable;
+    into->truncated += from->truncated;
+    into->spectator += from->spectator;
+    into->turns += from->turns;
+    into->reports += from->reports;
+    into->bad_reports += from->bad_reports;
+    into->flagged_files += from->flagged_files;
+}
+
+static void *verify_worker(void *arg) {
+    VerifyRun *run = arg;
+    FileResult *fr = malloc(sizeof(FileResult));
+    if (!fr) return NULL;
+    char name[256], path[VERIFY_PATH_MAX];
+
+    run_lock(run);
+    while (dir_next(run, name, sizeof(name))) {
+        run_unlock(run);
+        snprintf(path, sizeof(path), "%s/%s", run->dir, name);
+        verify_file(path, name, fr);
+
+        run_lock(run);
+        add_totals(&run->totals, &fr->counts);
+        if (fr->flags_len) fwrite(fr->flags, 1, fr->flags_len, stdout);
+        if (fr->counts.bad_reports > VERIFY_MAX_FLAGS_PER_FILE)
+            printf("[VERIFY] %s: %lu more bad reports\n", name,
+                   fr->counts.bad_reports - VERIFY_MAX_FLAGS_PER_FILE);
+        long long now = current_time_ms();
+        if (now - run->progress_ms >= VERIFY_PROGRESS_MS) {
+            run->progress_ms = now;
+            long long ms = now - run->started_ms;
+            printf("[VERIFY] %lu files, %lu turns, %lu flagged (%.0f files/s)\n", run->totals.files,
+                   run->totals.turns, run->totals.flagged_files, ms > 0 ? run->totals.files * 1000.0 / ms : 0.0);
+            fflush(stdout);
+        }
+    }
+    run_unlock(run);
+    free(fr);
+    return NULL;
+}
+
+static int default_threads(void) {
+#ifdef _WIN32
+    return 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+bool verify_journals(const char *dir, int threads, VerifyTotals *out) {
+    VerifyRun run;
+    memset(&run, 0, sizeof(run));
+    run.dir = dir;
+    if (!dir_open(&run)) return false;
+    run.started_ms = run.progress_ms = current_time_ms();
+
+    if (threads <= 0) threads = default_threads();
+    if (threads > VERIFY_MAX_THREADS) threads = VERIFY_MAX_THREADS;
+#ifdef _WIN32
+    threads = 1; // no worker pool here: verify on the calling thread
+    verify_worker(&run);
+#else
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_t pool[VERIFY_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++)
+        if (pthread_create(&pool[started], NULL, verify_worker, &run) == 0) started++;
+    verify_worker(&run); // the calling thread takes a share too
+    for (int i = 0; i < started; i++)
+        pthread_join(pool[i], NULL);
+    pthread_mutex_destroy(&run.lock);
+#endif
+    dir_close(&run);
+    *out = run.totals;
+    return true;
+}
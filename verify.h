@@ -0,0 +1,31 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdbool.h>
+
+// Offline audit of recorded battles: every journal in a directory is read
+// on its own thread from a pool, every turn is recomputed with
+// calculate_damage_logic(), and each CALCULATION_REPORT (ours and the
+// peer's) is checked against it. Only one journal per thread is in memory
+// at a time; findings are printed as they turn up.
+
+#define VERIFY_MAX_THREADS 64
+#define VERIFY_PROGRESS_MS 1000     // how often the running totals line is printed
+#define VERIFY_MAX_FLAGS_PER_FILE 8 // further bad turns in a file are only counted
+
+typedef struct {
+    unsigned long files;
+    unsigned long unreadable;   // not a journal, or it couldn't be opened
+    unsigned long truncated;    // ended in a torn record (checked up to there)
+    unsigned long spectator;    // spectator journals carry no reports of their own
+    unsigned long turns;
+    unsigned long reports;      // CALCULATION_REPORTs checked
+    unsigned long bad_reports;  // damage_dealt or defender_hp_remaining was wrong
+    unsigned long flagged_files;
+} VerifyTotals;
+
+// Verifies every *.pkj file in dir. threads <= 0 uses one per core.
+// False if dir can't be read.
+bool verify_journals(const char *dir, int threads, VerifyTotals *out);
+
+#endif